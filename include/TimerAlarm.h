@@ -29,9 +29,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
 
+#include <array>
 #include <atomic>
+#include <chrono>
 #include <concepts>
 #include <condition_variable>
+#include <cstdint>
 #include <cstdlib>
 #include <ctime>
 #include <mutex>
@@ -41,6 +44,60 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 namespace hmta
 {
 
+// How the next expiry is computed.
+//
+enum class timer_mode : unsigned char  {
+
+    // Wait the interval after the functor returns. The period is interval
+    // plus functor run time, so the timer drifts. This is the default.
+    //
+    relative = 0,
+
+    // Deadlines are arm time + N * interval on CLOCK_MONOTONIC (what
+    // std::chrono::steady_clock reads), independent of the functor's run
+    // time.
+    //
+    absolute = 1,
+};
+
+// What an absolute timer does with deadlines that passed while the functor
+// was still running.
+//
+enum class missed_policy : unsigned char  {
+
+    skip = 0,      // Drop them and wait for the next deadline in phase.
+    catch_up = 1,  // Run the functor once per missed deadline, back to back.
+    coalesce = 2,  // Run the functor once now, then continue in phase.
+};
+
+// ----------------------------------------------------------------------------
+
+// Log2-bucketed histogram of nano-second samples. Bucket i holds samples
+// in [2^i, 2^(i+1)) ns; bucket 0 also holds 0 and negative samples.
+//
+struct  TimerHistogram  {
+
+    using size_type = std::size_t;
+
+    static constexpr size_type  BUCKETS = 40;  // up to ~18 minutes
+
+    std::array<size_type, BUCKETS>  buckets { };
+    size_type                       count { 0 };
+    std::int64_t                    min_ns { 0 };
+    std::int64_t                    max_ns { 0 };
+    double                          sum_ns { 0 };
+
+    void add(std::int64_t ns) noexcept;
+
+    double mean() const noexcept;
+
+    // Upper bound of the bucket holding the p-th percentile (0 < p <= 100).
+    //
+    std::int64_t percentile(double p) const noexcept;
+};
+
+// ----------------------------------------------------------------------------
+
 // F must define the operator()() which will be executed on either
 // the engine_routine thread.
 //
@@ -87,8 +144,26 @@ public:
     inline bool is_armed() const noexcept;
     inline size_type current_repeat_count() const noexcept;
 
+    // Selects relative or absolute deadlines and the missed-deadline
+    // policy. It is _not_ OK (exception) to call it on an armed timer.
+    //
+    bool set_schedule(timer_mode mode,
+                      missed_policy policy = missed_policy::skip);
+
+    // Deadlines that were skipped or coalesced under the missed policy.
+    //
+    inline size_type missed_count() const noexcept;
+
+    // Snapshots of how late the functor started against its deadline and
+    // how long it ran, safe to call while the timer is armed.
+    //
+    TimerHistogram lateness_histogram() const;
+    TimerHistogram duration_histogram() const;
+
 private:
 
+    using clock_type = std::chrono::steady_clock;
+
     bool engine_routine_() noexcept;
 
     std::atomic_bool        is_armed_ { false };
@@ -100,8 +175,16 @@ private:
 
     F                       &functor_;
 
+    timer_mode              mode_ { timer_mode::relative };
+    missed_policy           policy_ { missed_policy::skip };
+    std::atomic<size_type>  missed_ { 0 };
+
     mutable std::mutex      state_mutex_ { };
     std::condition_variable engine_cv_ { };
+
+    mutable std::mutex      stats_mutex_ { };
+    TimerHistogram          lateness_ { };
+    TimerHistogram          duration_ { };
 };
 
 } // namespace hmta
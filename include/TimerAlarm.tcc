@@ -29,6 +29,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 //#include <Cheetah/TimerAlarm.h>
 
+#include <algorithm>
 #include <chrono>
 #include <stdexcept>
 #include <thread>
@@ -146,7 +147,8 @@ bool TimerAlarm<F>::disarm()  {
 template<std::invocable F>
 bool TimerAlarm<F>::engine_routine_() noexcept  {
 
-    size_type   this_count { repeat_count_ };
+    size_type                   this_count { repeat_count_ };
+    clock_type::time_point      deadline { clock_type::now() };
 
     while (this_count-- > 0)  {
         if (! is_armed_.load(std::memory_order_relaxed))
@@ -154,21 +156,61 @@ bool TimerAlarm<F>::engine_routine_() noexcept  {
 
         {
             std::unique_lock<std::mutex>    guard { state_mutex_ };
-            const std::cv_status            signaled =
-                engine_cv_.wait_for(
-                    guard,
-                    std::chrono::nanoseconds(
-                        1000000000L * interval_sec_ + interval_nanosec_));
-
-            // If we were signaled, it was a signal to disarm. So get out
-            // of here immediately.
-            //
-            if (signaled == std::cv_status::no_timeout)
-                break;
+            const std::chrono::nanoseconds  interval {
+                1000000000L * interval_sec_ + interval_nanosec_ };
+            bool                            run_now { false };
+
+            if (mode_ == timer_mode::relative)  {
+                deadline = clock_type::now() + interval;
+            }
+            else  {
+                deadline += interval;
+
+                const clock_type::time_point    now { clock_type::now() };
+
+                // With catch_up a deadline in the past simply does not
+                // wait, so every missed deadline gets its run.
+                //
+                if (now > deadline && policy_ != missed_policy::catch_up)  {
+                    const size_type behind =
+                        static_cast<size_type>((now - deadline) / interval);
+
+                    if (policy_ == missed_policy::skip)  {
+                        deadline += interval * (behind + 1);
+                        missed_ += behind + 1;
+                    }
+                    else  {  // coalesce: one run now for all of them
+                        deadline += interval * behind;
+                        missed_ += behind;
+                        run_now = true;
+                    }
+                }
+            }
+
+            if (! run_now)  {
+                const std::cv_status    signaled =
+                    engine_cv_.wait_until(guard, deadline);
+
+                // If we were signaled, it was a signal to disarm. So get out
+                // of here immediately.
+                //
+                if (signaled == std::cv_status::no_timeout)
+                    break;
+            }
 		}
 
+        const clock_type::time_point    start { clock_type::now() };
+
         repeated_sofar_ += 1;
         functor_();
+
+        const clock_type::time_point    end { clock_type::now() };
+        const std::lock_guard<std::mutex>   stats_guard { stats_mutex_ };
+
+        lateness_.add(std::chrono::duration_cast<std::chrono::nanoseconds>
+                          (start - deadline).count());
+        duration_.add(std::chrono::duration_cast<std::chrono::nanoseconds>
+                          (end - start).count());
     }
 
     // In case we just run out of repeat count, disarm.
@@ -185,6 +227,87 @@ bool TimerAlarm<F>::engine_routine_() noexcept  {
 
 // ----------------------------------------------------------------------------
 
+template<std::invocable F>
+bool TimerAlarm<F>::set_schedule(timer_mode mode, missed_policy policy)  {
+
+    if (is_armed_.load(std::memory_order_relaxed))
+        throw std::runtime_error { "TimerAlarm::set_schedule(): "
+                                   "The time/alarm is armed." };
+
+    const std::lock_guard<std::mutex>   guard { state_mutex_ };
+
+    mode_ = mode;
+    policy_ = policy;
+    return (true);
+}
+
+// ----------------------------------------------------------------------------
+
+template<std::invocable F>
+typename TimerAlarm<F>::size_type TimerAlarm<F>::
+missed_count() const noexcept  { return (missed_.load()); }
+
+// ----------------------------------------------------------------------------
+
+template<std::invocable F>
+TimerHistogram TimerAlarm<F>::lateness_histogram() const  {
+
+    const std::lock_guard<std::mutex>   guard { stats_mutex_ };
+
+    return (lateness_);
+}
+
+// ----------------------------------------------------------------------------
+
+template<std::invocable F>
+TimerHistogram TimerAlarm<F>::duration_histogram() const  {
+
+    const std::lock_guard<std::mutex>   guard { stats_mutex_ };
+
+    return (duration_);
+}
+
+// ----------------------------------------------------------------------------
+
+inline void TimerHistogram::add(std::int64_t ns) noexcept  {
+
+    size_type   bucket { 0 };
+
+    for (std::int64_t v = ns; v > 1 && bucket < BUCKETS - 1; v >>= 1)
+        bucket += 1;
+    buckets[bucket] += 1;
+    if (count == 0 || ns < min_ns)  min_ns = ns;
+    if (count == 0 || ns > max_ns)  max_ns = ns;
+    sum_ns += static_cast<double>(ns);
+    count += 1;
+}
+
+// ----------------------------------------------------------------------------
+
+inline double TimerHistogram::mean() const noexcept  {
+
+    return (count == 0 ? 0.0 : sum_ns / static_cast<double>(count));
+}
+
+// ----------------------------------------------------------------------------
+
+inline std::int64_t TimerHistogram::percentile(double p) const noexcept  {
+
+    if (count == 0)  return (0);
+
+    const double    wanted { p / 100.0 * static_cast<double>(count) };
+    size_type       sofar { 0 };
+
+    for (size_type i = 0; i < BUCKETS; ++i)  {
+        sofar += buckets[i];
+        if (static_cast<double>(sofar) >= wanted)
+            return (std::min(max_ns, (std::int64_t(1) << (i + 1)) - 1));
+    }
+    return (max_ns);
+}
+
+// ----------------------------------------------------------------------------
+
 template<std::invocable F>
 bool TimerAlarm<F>::is_armed() const noexcept  {
 
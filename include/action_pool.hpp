@@ -0,0 +1,266 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class ActionPool
+ * @brief Bounded pool of worker threads that run watch actions (scripts)
+ * off the poll thread.
+ *
+ * Requests go through a bounded queue.  At most per_key_limit requests with
+ * the same key (the watch name) run at once; the others wait in the queue
+ * while requests for other keys go ahead.  When the queue is full the
+ * overflow policy decides: reject the new request, drop the oldest queued
+ * one, or block the caller until there is room.  Blocking stalls the
+ * caller, so the monitor itself never uses it.
+ *
+ * Completions are handed to the poster, e.g. EventLoop::post, so they run
+ * on the monitor's thread; without a poster they run on a worker.  That
+ * includes the completion of a request dropped by submit(): the caller may
+ * hold a lock its done callback takes, so it never runs on the caller.
+ */
+class ActionPool {
+public:
+  enum class Overflow { reject, drop_oldest, block };
+
+  struct Result {
+    std::string key;
+    bool ok = false;
+    std::string output;
+    std::string error; // what() of the exception, or why it was dropped
+    std::chrono::milliseconds runtime{0};
+  };
+
+  using Work = std::function<std::string()>; // throws on failure
+  using Done = std::function<void(const Result &)>;
+  using Poster = std::function<void(std::function<void()>)>;
+
+  ActionPool(size_t workers, size_t capacity, Overflow overflow,
+             size_t per_key_limit = 1)
+      : capacity_(capacity > 0 ? capacity : 1), overflow_(overflow),
+        per_key_limit_(per_key_limit > 0 ? per_key_limit : 1) {
+    for (size_t i = 0; i < (workers > 0 ? workers : 1); i++) {
+      workers_.emplace_back(&ActionPool::work, this);
+    }
+  }
+
+  // Waits for running actions; queued ones are dropped without completion.
+  ~ActionPool() {
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      stop_ = true;
+      queue_.clear();
+      orphans_.clear();
+    }
+    work_cv_.notify_all();
+    space_cv_.notify_all();
+    for (auto &t : workers_) {
+      t.join();
+    }
+  }
+
+  ActionPool(const ActionPool &) = delete;
+  ActionPool &operator=(const ActionPool &) = delete;
+
+  void setPoster(Poster poster) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    poster_ = std::move(poster);
+  }
+
+  /**
+   * @brief Queues work under key; done gets the result.
+   * @return false if the request was rejected because the queue is full.
+   */
+  bool submit(const std::string &key, Work work, Done done) {
+    std::unique_lock<std::mutex> lock(mtx_);
+    if (stop_) {
+      return false;
+    }
+    ++submitted_;
+    std::optional<Request> dropped;
+    if (queue_.size() >= capacity_) {
+      switch (overflow_) {
+      case Overflow::reject:
+        ++rejected_;
+        return false;
+      case Overflow::drop_oldest:
+        dropped = std::move(queue_.front());
+        queue_.pop_front();
+        ++dropped_;
+        break;
+      case Overflow::block:
+        space_cv_.wait(lock,
+                       [&] { return stop_ || queue_.size() < capacity_; });
+        if (stop_) {
+          return false;
+        }
+        break;
+      }
+    }
+    queue_.push_back(Request{key, std::move(work), std::move(done)});
+    work_cv_.notify_one();
+
+    if (dropped && dropped->done) {
+      Result r;
+      r.key = dropped->key;
+      r.error = "dropped, action queue full";
+      if (poster_) {
+        Poster poster = poster_;
+        lock.unlock();
+        poster([done = std::move(dropped->done), r = std::move(r)]() {
+          done(r);
+        });
+      } else {
+        orphans_.push_back(Orphan{std::move(dropped->done), std::move(r)});
+        work_cv_.notify_one();
+      }
+    }
+    return true;
+  }
+
+  size_t queued() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return queue_.size();
+  }
+
+  size_t running() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return running_;
+  }
+
+  size_t perKeyLimit() const { return per_key_limit_; }
+  uint64_t submitted() const { return submitted_; }
+  uint64_t completed() const { return completed_; }
+  uint64_t rejected() const { return rejected_; }
+  uint64_t dropped() const { return dropped_; }
+
+  static std::optional<Overflow> parseOverflow(const std::string &name) {
+    if (name == "reject") {
+      return Overflow::reject;
+    }
+    if (name == "drop_oldest") {
+      return Overflow::drop_oldest;
+    }
+    if (name == "block") {
+      return Overflow::block;
+    }
+    return std::nullopt;
+  }
+
+private:
+  struct Request {
+    std::string key;
+    Work work;
+    Done done;
+  };
+
+  // completion of a dropped request, waiting for a worker to run it
+  struct Orphan {
+    Done done;
+    Result result;
+  };
+
+  // first queued request whose key is below its concurrency limit
+  std::deque<Request>::iterator runnable() {
+    for (auto it = queue_.begin(); it != queue_.end(); ++it) {
+      auto active = active_.find(it->key);
+      if (active == active_.end() || active->second < per_key_limit_) {
+        return it;
+      }
+    }
+    return queue_.end();
+  }
+
+  void work() {
+    std::unique_lock<std::mutex> lock(mtx_);
+    for (;;) {
+      work_cv_.wait(lock, [&] {
+        return stop_ || !orphans_.empty() || runnable() != queue_.end();
+      });
+      if (stop_) {
+        return;
+      }
+      if (!orphans_.empty()) {
+        Orphan orphan = std::move(orphans_.front());
+        orphans_.pop_front();
+        complete(lock, std::move(orphan.done), std::move(orphan.result));
+        continue;
+      }
+      auto it = runnable();
+      Request req = std::move(*it);
+      queue_.erase(it);
+      ++active_[req.key];
+      ++running_;
+      space_cv_.notify_one();
+      lock.unlock();
+
+      Result r;
+      r.key = req.key;
+      auto start = std::chrono::steady_clock::now();
+      try {
+        r.output = req.work();
+        r.ok = true;
+      } catch (const std::exception &e) {
+        r.error = e.what();
+      } catch (...) {
+        r.error = "unknown error";
+      }
+      r.runtime = std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - start);
+
+      lock.lock();
+      if (--active_[req.key] == 0) {
+        active_.erase(req.key);
+      }
+      --running_;
+      ++completed_;
+      // a request held back by its key's limit may be runnable now
+      work_cv_.notify_all();
+      complete(lock, std::move(req.done), std::move(r));
+    }
+  }
+
+  // Called with the lock held; returns with it held.
+  void complete(std::unique_lock<std::mutex> &lock, Done done, Result r) {
+    if (!done) {
+      return;
+    }
+    Poster poster = poster_;
+    lock.unlock();
+    if (poster) {
+      poster([done = std::move(done), r = std::move(r)]() { done(r); });
+    } else {
+      done(r);
+    }
+    lock.lock();
+  }
+
+  const size_t capacity_;
+  const Overflow overflow_;
+  const size_t per_key_limit_;
+  std::deque<Request> queue_;
+  std::deque<Orphan> orphans_;
+  std::unordered_map<std::string, size_t> active_; // running per key
+  size_t running_ = 0;
+  Poster poster_;
+  bool stop_ = false;
+  uint64_t submitted_ = 0;
+  uint64_t completed_ = 0;
+  uint64_t rejected_ = 0;
+  uint64_t dropped_ = 0;
+  std::mutex mtx_;
+  std::condition_variable work_cv_;
+  std::condition_variable space_cv_;
+  std::vector<std::thread> workers_;
+};
@@ -1,15 +1,5 @@
-struct ProcessInfo {
-  std::string name;
-  int pid;
-  std::string user; // Add a field for the username
-  std::vector<std::string> arguments;
-};
-
-struct matchProcess {
-  std::string process_name;
-  std::string username;
-  std::string argument;
-};
+#include "process_info.hpp"
+#include "uid_cache.hpp"
 
 class ProcessLister {
 public:
@@ -33,12 +23,8 @@ public:
         proc.name = procs[i].ki_comm;
 
         // Get the username from the UID
-        struct passwd *pw = getpwuid(procs[i].ki_uid);
-        if (pw != nullptr) {
-          proc.user = pw->pw_name;
-        } else {
-          proc.user = "Unknown";
-        }
+        proc.uid = procs[i].ki_uid;
+        proc.user = uidCache().name(procs[i].ki_uid);
 
         // Get the command line arguments for the process
         char **argv = kvm_getargv(kd, &procs[i], 0);
@@ -79,19 +65,11 @@ public:
   }
 
   void logSingleProcess(const ProcessInfo &proc) {
-    std::string logMessage = "Process ID: " + std::to_string(proc.pid) +
-                             ", Process Name: " + proc.name +
-                             ", User: " + proc.user;
-
-    if (!proc.arguments.empty()) {
-      logMessage += ", Arguments: ";
-      for (const auto &arg : proc.arguments) {
-        logMessage += arg + ' ';
-      }
-    }
-
-    logMessage += "num args: " + std::to_string(proc.arguments.size()) + " ";
-    logger.log(logMessage);
+    logger.event("process", {{"pid", proc.pid},
+                             {"name", proc.name},
+                             {"user", proc.user},
+                             {"args", proc.arguments},
+                             {"nargs", proc.arguments.size()}});
   }
 
   void logProcesses(const std::vector<ProcessInfo> &processList) {
@@ -133,7 +111,7 @@ public:
       if (process.name == searchCriteria.process_name) {
         // Check if the username matches
         // logger.log(" match - process name: " + searchCriteria.process_name);
-        if (process.user == searchCriteria.username) {
+        if (userMatches(process, searchCriteria)) {
           // Check if any argument matches
           // logger.log(" match - user name: " + searchCriteria.username);
           if (std::any_of(process.arguments.begin(), process.arguments.end(),
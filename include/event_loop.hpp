@@ -0,0 +1,273 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class EventLoop
+ * @brief The daemon's reactor: one epoll set for timers (timerfd), signals
+ * (signalfd) and any other fd - script output pipes, the pidfd watcher, the
+ * timer wheel.
+ *
+ * Callbacks run on the thread that called run().  addFd(), removeFd() and
+ * post() may be called from any thread; onSignal() must be called before
+ * other threads are started so they inherit the blocked signal mask.
+ */
+class EventLoop {
+public:
+  using FdCallback = std::function<void(uint32_t events)>;
+  using Callback = std::function<void()>;
+  using TimerId = int; // the timerfd
+
+  EventLoop() {
+    epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (epoll_fd_ >= 0 && wake_fd_ >= 0) {
+      addFd(wake_fd_, EPOLLIN, [this](uint32_t) { runPosted(); });
+    }
+  }
+
+  ~EventLoop() {
+    for (const auto &entry : handlers_) {
+      if (entry.second->owned) {
+        ::close(entry.first);
+      }
+    }
+    if (wake_fd_ >= 0) {
+      ::close(wake_fd_);
+    }
+    if (epoll_fd_ >= 0) {
+      ::close(epoll_fd_);
+    }
+  }
+
+  EventLoop(const EventLoop &) = delete;
+  EventLoop &operator=(const EventLoop &) = delete;
+
+  bool isValid() const { return epoll_fd_ >= 0 && wake_fd_ >= 0; }
+
+  /**
+   * @brief Calls cb(events) whenever fd is ready.  The loop does not take
+   * ownership of fd.
+   */
+  bool addFd(int fd, uint32_t events, FdCallback cb) {
+    return add(fd, events, std::move(cb), false);
+  }
+
+  bool modifyFd(int fd, uint32_t events) {
+    struct epoll_event ev = {};
+    ev.events = events;
+    ev.data.fd = fd;
+    return ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev) == 0;
+  }
+
+  // Stops watching fd; closes it if the loop created it.
+  void removeFd(int fd) {
+    std::shared_ptr<Handler> handler;
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      auto it = handlers_.find(fd);
+      if (it == handlers_.end()) {
+        return;
+      }
+      handler = it->second;
+      handlers_.erase(it);
+    }
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    if (handler->owned) {
+      ::close(fd);
+    }
+  }
+
+  /**
+   * @brief Calls cb every interval (once, if periodic is false), first after
+   * one interval.  Uses a CLOCK_MONOTONIC timerfd; expirations missed while
+   * a callback ran are folded into one call.
+   * @return Id for cancelTimer(), -1 on failure.
+   */
+  TimerId addTimer(std::chrono::nanoseconds interval, Callback cb,
+                   bool periodic = true) {
+    int fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+      return -1;
+    }
+    struct itimerspec its = {};
+    its.it_value = toTimespec(interval);
+    if (periodic) {
+      its.it_interval = its.it_value;
+    }
+    if (::timerfd_settime(fd, 0, &its, nullptr) < 0 ||
+        !add(fd, EPOLLIN,
+             [fd, cb = std::move(cb)](uint32_t) {
+               uint64_t expirations;
+               if (::read(fd, &expirations, sizeof(expirations)) > 0) {
+                 cb();
+               }
+             },
+             true)) {
+      ::close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  void cancelTimer(TimerId id) { removeFd(id); }
+
+  /**
+   * @brief Blocks sig for the calling thread and calls cb from the loop
+   * when it arrives.
+   */
+  bool onSignal(int sig, Callback cb) {
+    signal_callbacks_[sig] = std::move(cb);
+    sigaddset(&signals_, sig);
+    pthread_sigmask(SIG_BLOCK, &signals_, nullptr);
+    if (signal_fd_ >= 0) {
+      return ::signalfd(signal_fd_, &signals_, SFD_NONBLOCK | SFD_CLOEXEC) >= 0;
+    }
+    signal_fd_ = ::signalfd(-1, &signals_, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd_ < 0) {
+      return false;
+    }
+    return add(signal_fd_, EPOLLIN, [this](uint32_t) { readSignals(); }, true);
+  }
+
+  // Runs cb on the loop thread; safe from any thread.
+  void post(Callback cb) {
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      posted_.push_back(std::move(cb));
+    }
+    wakeup();
+  }
+
+  /**
+   * @brief Dispatches events until stop() is called.
+   */
+  void run() {
+    struct epoll_event events[32];
+    while (!stopped_) {
+      int n = ::epoll_wait(epoll_fd_, events, 32, -1);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        break;
+      }
+      ++wakeups_;
+      for (int i = 0; i < n; i++) {
+        std::shared_ptr<Handler> handler;
+        {
+          std::lock_guard<std::mutex> lock(mtx_);
+          auto it = handlers_.find(events[i].data.fd);
+          if (it == handlers_.end()) {
+            continue; // removed by an earlier callback
+          }
+          handler = it->second;
+        }
+        handler->cb(events[i].events);
+      }
+    }
+  }
+
+  // Makes run() return after the current dispatch; safe from any thread.
+  void stop() {
+    stopped_ = true;
+    wakeup();
+  }
+
+  uint64_t wakeups() const { return wakeups_; }
+
+private:
+  struct Handler {
+    FdCallback cb;
+    bool owned; // created by the loop, closed on removal
+  };
+
+  static struct timespec toTimespec(std::chrono::nanoseconds d) {
+    if (d.count() <= 0) {
+      d = std::chrono::nanoseconds(1);
+    }
+    struct timespec ts;
+    ts.tv_sec = static_cast<time_t>(d.count() / 1000000000);
+    ts.tv_nsec = static_cast<long>(d.count() % 1000000000);
+    return ts;
+  }
+
+  bool add(int fd, uint32_t events, FdCallback cb, bool owned) {
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      handlers_[fd] = std::make_shared<Handler>(Handler{std::move(cb), owned});
+    }
+    struct epoll_event ev = {};
+    ev.events = events;
+    ev.data.fd = fd;
+    if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      std::lock_guard<std::mutex> lock(mtx_);
+      handlers_.erase(fd);
+      return false;
+    }
+    return true;
+  }
+
+  void wakeup() {
+    uint64_t one = 1;
+    ssize_t rc = ::write(wake_fd_, &one, sizeof(one));
+    (void)rc;
+  }
+
+  void runPosted() {
+    uint64_t value;
+    ssize_t rc = ::read(wake_fd_, &value, sizeof(value));
+    (void)rc;
+    std::vector<Callback> posted;
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      posted.swap(posted_);
+    }
+    for (auto &cb : posted) {
+      cb();
+    }
+  }
+
+  void readSignals() {
+    struct signalfd_siginfo info;
+    while (::read(signal_fd_, &info, sizeof(info)) ==
+           static_cast<ssize_t>(sizeof(info))) {
+      auto it = signal_callbacks_.find(static_cast<int>(info.ssi_signo));
+      if (it != signal_callbacks_.end()) {
+        it->second();
+      }
+    }
+  }
+
+  int epoll_fd_ = -1;
+  int wake_fd_ = -1;
+  int signal_fd_ = -1;
+  sigset_t signals_ = initSigset();
+  std::unordered_map<int, Callback> signal_callbacks_;
+  std::unordered_map<int, std::shared_ptr<Handler>> handlers_;
+  std::vector<Callback> posted_;
+  std::atomic<bool> stopped_{false};
+  uint64_t wakeups_ = 0;
+  std::mutex mtx_;
+
+  static sigset_t initSigset() {
+    sigset_t set;
+    sigemptyset(&set);
+    return set;
+  }
+};
@@ -1,64 +1,52 @@
 #include <dirent.h>
-
-struct ProcessInfo {
-  std::string name;
-  int pid;
-  std::string user; // Add a field for the username
-  std::vector<std::string> arguments;
-};
-
-struct matchProcess {
-  std::string process_name;
-  std::string username;
-  std::string argument;
-};
+#include "process_info.hpp"
+#include "proc_scanner.hpp"
 
 class ProcessLister {
 public:
   std::set<int> pid_cache;
+  ScanStats scan_stats; // running totals for getMatchingProcesses
+
+  explicit ProcessLister(const std::string &proc_root = "/proc")
+      : scanner_(proc_root) {}
+
+  // procfs root to scan, "/proc" unless pointed at a synthetic tree
+  void setProcRoot(const std::string &proc_root) {
+    scanner_.setRoot(proc_root);
+  }
+  const std::string &procRoot() const { return scanner_.root(); }
 
   std::vector<ProcessInfo> getProcesses() {
     std::vector<ProcessInfo> processList;
-    std::string line;
-    std::ifstream procFile("/proc");
-
-    for (const auto &entry : std::filesystem::directory_iterator("/proc")) {
-      if (entry.is_directory()) {
-        std::string pidStr = entry.path().filename().string();
-        if (std::all_of(pidStr.begin(), pidStr.end(), ::isdigit)) {
-          ProcessInfo proc;
-          proc.pid = std::stoi(pidStr);
-
-          std::ifstream cmdlineFile(entry.path() / "cmdline");
-          std::getline(cmdlineFile, line, '\0');
-          std::istringstream iss(line);
-          std::getline(iss, proc.name, '\0');
-
-          std::ifstream statusFile(entry.path() / "status");
-          while (std::getline(statusFile, line)) {
-            if (line.find("Uid:") == 0) {
-              std::istringstream uidStream(line.substr(5));
-              int uid;
-              uidStream >> uid;
-              struct passwd *pw = getpwuid(uid);
-              proc.user = (pw != nullptr) ? pw->pw_name : "Unknown";
-              break;
-            }
-          }
-
-          std::ifstream argsFile(entry.path() / "cmdline");
-          while (std::getline(argsFile, line, '\0')) {
-            proc.arguments.push_back(line);
-          }
-
-          processList.push_back(proc);
-          if (searchPidcache(proc.pid) == true) {
-            logger.log("found pid: : " + std::to_string(proc.pid));
-            std::swap(processList.front(), processList.back());
-          }
-        }
+    scanner_.scan([&](ProcessInfo &&proc) {
+      processList.push_back(std::move(proc));
+      if (searchPidcache(processList.back().pid) == true) {
+        logger.log("found pid: : " + std::to_string(processList.back().pid));
+        std::swap(processList.front(), processList.back());
       }
-    }
+    });
+    return processList;
+  }
+
+  // Staged scan: only processes whose name and user already match are
+  // loaded in full.  Returns those, ready for searchProcess.
+  std::vector<ProcessInfo> getMatchingProcesses(const matchProcess &criteria,
+                                                ScanStats &stats) {
+    return getMatchingProcesses(MatchFilter{criteria}, stats);
+  }
+
+  // Same with any scanStaged filter, e.g. one covering several watches.
+  template <typename Filter>
+  std::vector<ProcessInfo> getMatchingProcesses(const Filter &filter,
+                                                ScanStats &stats) {
+    std::vector<ProcessInfo> processList;
+    scanner_.scanStaged(filter, stats, [&](ProcessInfo &&proc) {
+      processList.push_back(std::move(proc));
+      if (searchPidcache(processList.back().pid) == true) {
+        std::swap(processList.front(), processList.back());
+      }
+    });
+    scan_stats += stats;
     return processList;
   }
 
@@ -79,19 +67,11 @@ public:
   }
 
   void logSingleProcess(const ProcessInfo &proc) {
-    std::string logMessage = "Process ID: " + std::to_string(proc.pid) +
-                             ", Process Name: " + proc.name +
-                             ", User: " + proc.user;
-
-    if (!proc.arguments.empty()) {
-      logMessage += ", Arguments: ";
-      for (const auto &arg : proc.arguments) {
-        logMessage += arg + ' ';
-      }
-    }
-
-    logMessage += "num args: " + std::to_string(proc.arguments.size()) + " ";
-    logger.log(logMessage);
+    logger.event("process", {{"pid", proc.pid},
+                             {"name", proc.name},
+                             {"user", proc.user},
+                             {"args", proc.arguments},
+                             {"nargs", proc.arguments.size()}});
   }
 
   void logProcesses(const std::vector<ProcessInfo> &processList) {
@@ -106,33 +86,51 @@ public:
     foundProcess = nullptr;
     // Iterate through the list of processes
     for (const auto &process : processList) {
-      // Check if the process name matches
-      if (process.name == searchCriteria.process_name) {
-        // Check if the username matches
-        // logger.log(" match - process name: " + searchCriteria.process_name);
-        if (process.user == searchCriteria.username) {
-          // Check if any argument matches
-          // logger.log(" match - user name: " + searchCriteria.username);
-          if (std::any_of(process.arguments.begin(), process.arguments.end(),
-                          [&](const std::string &arg) {
-                            return arg.find(searchCriteria.argument) !=
-                                   std::string::npos;
-                          })) {
-            logger.log(" matach -> " + searchCriteria.argument);
-            logger.log(" match - user name: " + searchCriteria.username);
-            logger.log(" match - process name: " + searchCriteria.process_name);
-            foundProcess = &process;
-            setPidcache(process.pid);
-            return true; // All conditions met
-          }
-        }
+      if (matchesCriteria(process, searchCriteria)) {
+        foundProcess = &process;
+        logMatch(process, searchCriteria);
+        return true; // All conditions met
       }
     }
-    logger.log(" no match found -> process: " + searchCriteria.process_name +
-               " user:  " + searchCriteria.username);
-    flushPidcache();
+    logNoMatch(searchCriteria);
     return false; // No matching process found
   }
+
+  // Same search over a subset of a table, e.g. the processes a
+  // ProcSnapshot refresh added.
+  bool searchProcess(const std::vector<const ProcessInfo *> &candidates,
+                     const matchProcess &searchCriteria,
+                     const ProcessInfo *&foundProcess) {
+    foundProcess = nullptr;
+    for (const ProcessInfo *process : candidates) {
+      if (matchesCriteria(*process, searchCriteria)) {
+        foundProcess = process;
+        logMatch(*process, searchCriteria);
+        return true;
+      }
+    }
+    logNoMatch(searchCriteria);
+    return false;
+  }
+
+  static bool matchesCriteria(const ProcessInfo &process,
+                              const matchProcess &searchCriteria) {
+    // Check if the process name matches
+    if (process.name != searchCriteria.process_name) {
+      return false;
+    }
+    // Check if the username matches
+    if (!userMatches(process, searchCriteria)) {
+      return false;
+    }
+    // Check if any argument matches
+    return std::any_of(process.arguments.begin(), process.arguments.end(),
+                       [&](const std::string &arg) {
+                         return arg.find(searchCriteria.argument) !=
+                                std::string::npos;
+                       });
+  }
+
   void setPidcache(const int p) {
     if (pid_cache.find(p) == pid_cache.end()) {
       pid_cache.insert(p);
@@ -155,4 +153,20 @@ public:
       logger.log("flushing cache");
     }
   }
+
+private:
+  void logMatch(const ProcessInfo &process, const matchProcess &searchCriteria) {
+    logger.log(" matach -> " + searchCriteria.argument);
+    logger.log(" match - user name: " + searchCriteria.username);
+    logger.log(" match - process name: " + searchCriteria.process_name);
+    setPidcache(process.pid);
+  }
+
+  void logNoMatch(const matchProcess &searchCriteria) {
+    logger.log(" no match found -> process: " + searchCriteria.process_name +
+               " user:  " + searchCriteria.username);
+    flushPidcache();
+  }
+
+  ProcScanner scanner_;
 };
@@ -0,0 +1,474 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <initializer_list>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+enum class LogFormat { text, json, binary };
+
+inline std::optional<LogFormat> parseLogFormat(const std::string &name) {
+  if (name == "text") {
+    return LogFormat::text;
+  }
+  if (name == "json") {
+    return LogFormat::json;
+  }
+  if (name == "binary") {
+    return LogFormat::binary;
+  }
+  return std::nullopt;
+}
+
+/**
+ * @class LogField
+ * @brief One typed key/value of a structured log record.
+ *
+ * A field only refers to its key and to string values, it copies nothing;
+ * the caller's strings must outlive the log call, which they do when the
+ * fields are written as a braced list in the call itself:
+ *
+ *   logger.event("process", {{"pid", proc.pid}, {"name", proc.name}});
+ */
+struct LogField {
+  enum class Type : uint8_t { i64 = 1, u64, f64, boolean, str, strs };
+
+  std::string_view key;
+  Type type;
+  union {
+    int64_t i;
+    uint64_t u;
+    double d;
+    bool b;
+    const std::vector<std::string> *list;
+  };
+  std::string_view s;
+
+  template <typename T,
+            std::enable_if_t<std::is_integral_v<T> && std::is_signed_v<T>, int> = 0>
+  LogField(std::string_view k, T v) : key(k), type(Type::i64), i(v) {}
+  template <typename T,
+            std::enable_if_t<std::is_integral_v<T> && std::is_unsigned_v<T> &&
+                                 !std::is_same_v<T, bool>,
+                             int> = 0>
+  LogField(std::string_view k, T v) : key(k), type(Type::u64), u(v) {}
+  LogField(std::string_view k, bool v) : key(k), type(Type::boolean), b(v) {}
+  LogField(std::string_view k, double v) : key(k), type(Type::f64), d(v) {}
+  LogField(std::string_view k, std::string_view v)
+      : key(k), type(Type::str), u(0), s(v) {}
+  LogField(std::string_view k, const std::string &v)
+      : key(k), type(Type::str), u(0), s(v) {}
+  LogField(std::string_view k, const char *v)
+      : key(k), type(Type::str), u(0), s(v) {}
+  LogField(std::string_view k, const std::vector<std::string> &v)
+      : key(k), type(Type::strs), list(&v) {}
+};
+
+using LogFields = std::span<const LogField>;
+
+/**
+ * @class LogEncoder
+ * @brief Appends one record, in one of the three formats, to a buffer the
+ * caller reuses, so a record costs no allocation once the buffer has grown.
+ *
+ * text:   "<prefix><event> key=value ...\n", or "<prefix><msg>\n" for a
+ *         plain message, as the logger has always written.
+ * json:   {"ts":<unix seconds>,"event":"<event>","key":value,...}\n, or
+ *         {"ts":...,"msg":"..."}\n for a plain message.
+ * binary: a length-prefixed record, all integers little endian:
+ *           u8  kMagic
+ *           u32 length of what follows
+ *           i64 ts, u16 event length, event, u16 field count, then fields:
+ *             u8 key length, key, u8 type (LogField::Type), value:
+ *               i64/u64/f64: 8 bytes; boolean: 1 byte;
+ *               str: u32 length, bytes; strs: u32 count, then strs.
+ *         A plain message is an event with an empty name and one "msg"
+ *         field.
+ */
+class LogEncoder {
+public:
+  static constexpr uint8_t kMagic = 0xA5;
+
+  static void text(std::string &out, std::string_view prefix,
+                   std::string_view event, LogFields fields) {
+    out.append(prefix);
+    out.append(event);
+    for (const LogField &f : fields) {
+      out.push_back(' ');
+      out.append(f.key);
+      out.push_back('=');
+      textValue(out, f);
+    }
+    out.push_back('\n');
+  }
+
+  static void json(std::string &out, time_t ts, std::string_view event,
+                   LogFields fields) {
+    out.append("{\"ts\":");
+    number(out, static_cast<int64_t>(ts));
+    if (!event.empty()) {
+      out.append(",\"event\":");
+      jsonString(out, event);
+    }
+    for (const LogField &f : fields) {
+      out.push_back(',');
+      jsonString(out, f.key);
+      out.push_back(':');
+      jsonValue(out, f);
+    }
+    out.append("}\n");
+  }
+
+  static void binary(std::string &out, time_t ts, std::string_view event,
+                     LogFields fields) {
+    size_t start = out.size();
+    out.push_back(static_cast<char>(kMagic));
+    put(out, uint32_t(0)); // length, filled in below
+    put(out, static_cast<int64_t>(ts));
+    put(out, static_cast<uint16_t>(std::min<size_t>(event.size(), UINT16_MAX)));
+    out.append(event.substr(0, UINT16_MAX));
+    put(out, static_cast<uint16_t>(std::min<size_t>(fields.size(), UINT16_MAX)));
+    for (const LogField &f : fields) {
+      std::string_view key = f.key.substr(0, UINT8_MAX);
+      out.push_back(static_cast<char>(key.size()));
+      out.append(key);
+      out.push_back(static_cast<char>(f.type));
+      switch (f.type) {
+      case LogField::Type::i64:
+        put(out, f.i);
+        break;
+      case LogField::Type::u64:
+        put(out, f.u);
+        break;
+      case LogField::Type::f64: {
+        uint64_t bits;
+        std::memcpy(&bits, &f.d, sizeof(bits));
+        put(out, bits);
+        break;
+      }
+      case LogField::Type::boolean:
+        out.push_back(f.b ? 1 : 0);
+        break;
+      case LogField::Type::str:
+        putString(out, f.s);
+        break;
+      case LogField::Type::strs:
+        put(out, static_cast<uint32_t>(f.list->size()));
+        for (const std::string &item : *f.list) {
+          putString(out, item);
+        }
+        break;
+      }
+    }
+    uint32_t len = static_cast<uint32_t>(out.size() - start - 5);
+    for (int b = 0; b < 4; b++) {
+      out[start + 1 + b] = static_cast<char>(len >> (8 * b));
+    }
+  }
+
+  static void jsonString(std::string &out, std::string_view s) {
+    static const char hex[] = "0123456789abcdef";
+    out.push_back('"');
+    for (char c : s) {
+      switch (c) {
+      case '"':
+        out.append("\\\"");
+        break;
+      case '\\':
+        out.append("\\\\");
+        break;
+      case '\n':
+        out.append("\\n");
+        break;
+      case '\t':
+        out.append("\\t");
+        break;
+      case '\r':
+        out.append("\\r");
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          out.append("\\u00");
+          out.push_back(hex[(c >> 4) & 0xf]);
+          out.push_back(hex[c & 0xf]);
+        } else {
+          out.push_back(c); // UTF-8 passes through
+        }
+      }
+    }
+    out.push_back('"');
+  }
+
+private:
+  template <typename T> static void number(std::string &out, T v) {
+    char buf[32];
+    auto r = std::to_chars(buf, buf + sizeof(buf), v);
+    out.append(buf, r.ptr);
+  }
+
+  static void textValue(std::string &out, const LogField &f) {
+    switch (f.type) {
+    case LogField::Type::i64:
+      number(out, f.i);
+      break;
+    case LogField::Type::u64:
+      number(out, f.u);
+      break;
+    case LogField::Type::f64:
+      number(out, f.d);
+      break;
+    case LogField::Type::boolean:
+      out.append(f.b ? "true" : "false");
+      break;
+    case LogField::Type::str:
+      out.append(f.s);
+      break;
+    case LogField::Type::strs:
+      out.push_back('[');
+      for (size_t n = 0; n < f.list->size(); n++) {
+        if (n > 0) {
+          out.push_back(' ');
+        }
+        out.append((*f.list)[n]);
+      }
+      out.push_back(']');
+      break;
+    }
+  }
+
+  static void jsonValue(std::string &out, const LogField &f) {
+    switch (f.type) {
+    case LogField::Type::str:
+      jsonString(out, f.s);
+      break;
+    case LogField::Type::strs:
+      out.push_back('[');
+      for (size_t n = 0; n < f.list->size(); n++) {
+        if (n > 0) {
+          out.push_back(',');
+        }
+        jsonString(out, (*f.list)[n]);
+      }
+      out.push_back(']');
+      break;
+    case LogField::Type::f64:
+      if (f.d != f.d || f.d - f.d != 0) {
+        out.append("null"); // NaN and infinities are not JSON
+        break;
+      }
+      textValue(out, f);
+      break;
+    default:
+      textValue(out, f);
+    }
+  }
+
+  template <typename T> static void put(std::string &out, T v) {
+    using U = std::make_unsigned_t<T>;
+    U bits = static_cast<U>(v);
+    for (size_t b = 0; b < sizeof(T); b++) {
+      out.push_back(static_cast<char>(bits >> (8 * b)));
+    }
+  }
+
+  static void putString(std::string &out, std::string_view s) {
+    put(out, static_cast<uint32_t>(s.size()));
+    out.append(s);
+  }
+};
+
+/**
+ * @class LogDecoder
+ * @brief Turns binary records back into the text or JSON-lines format.
+ *
+ * feed() takes bytes as they are read and returns how many it consumed;
+ * an incomplete record at the end is left for the next call.  Bytes that
+ * do not start a record are skipped up to the next kMagic and counted in
+ * skipped().
+ */
+class LogDecoder {
+public:
+  explicit LogDecoder(LogFormat to = LogFormat::text) : to_(to) {}
+
+  size_t feed(const char *data, size_t len, std::string &out) {
+    size_t pos = 0;
+    while (pos < len) {
+      if (static_cast<uint8_t>(data[pos]) != LogEncoder::kMagic) {
+        ++pos;
+        ++skipped_;
+        continue;
+      }
+      if (len - pos < 5) {
+        break;
+      }
+      uint32_t body = static_cast<uint32_t>(get<uint32_t>(data + pos + 1));
+      if (len - pos - 5 < body) {
+        break;
+      }
+      if (decode(data + pos + 5, body, out)) {
+        pos += 5 + body;
+        ++records_;
+      } else {
+        ++pos; // not a record after all; resynchronise
+        ++skipped_;
+      }
+    }
+    return pos;
+  }
+
+  uint64_t records() const { return records_; }
+  uint64_t skipped() const { return skipped_; }
+
+private:
+  // a decoded field; string values point into the record
+  struct Field {
+    std::string_view key;
+    LogField::Type type;
+    int64_t i = 0;
+    uint64_t u = 0;
+    double d = 0;
+    bool b = false;
+    std::string_view s;
+    std::vector<std::string> list;
+  };
+
+  template <typename T> static T get(const char *p) {
+    uint64_t v = 0;
+    for (size_t b = 0; b < sizeof(T); b++) {
+      v |= static_cast<uint64_t>(static_cast<uint8_t>(p[b])) << (8 * b);
+    }
+    return static_cast<T>(v);
+  }
+
+  struct Reader {
+    const char *p;
+    const char *end;
+    bool ok = true;
+
+    const char *take(size_t n) {
+      if (!ok || static_cast<size_t>(end - p) < n) {
+        ok = false;
+        return nullptr;
+      }
+      const char *at = p;
+      p += n;
+      return at;
+    }
+    template <typename T> T num() {
+      const char *at = take(sizeof(T));
+      return at ? get<T>(at) : T();
+    }
+    std::string_view bytes(size_t n) {
+      const char *at = take(n);
+      return at ? std::string_view(at, n) : std::string_view();
+    }
+  };
+
+  bool decode(const char *body, size_t len, std::string &out) {
+    Reader r{body, body + len};
+    int64_t ts = r.num<int64_t>();
+    std::string_view event = r.bytes(r.num<uint16_t>());
+    uint16_t count = r.num<uint16_t>();
+    fields_.resize(count);
+    for (Field &f : fields_) {
+      f.key = r.bytes(r.num<uint8_t>());
+      f.type = static_cast<LogField::Type>(r.num<uint8_t>());
+      switch (f.type) {
+      case LogField::Type::i64:
+        f.i = r.num<int64_t>();
+        break;
+      case LogField::Type::u64:
+        f.u = r.num<uint64_t>();
+        break;
+      case LogField::Type::f64: {
+        uint64_t bits = r.num<uint64_t>();
+        std::memcpy(&f.d, &bits, sizeof(bits));
+        break;
+      }
+      case LogField::Type::boolean:
+        f.b = r.num<uint8_t>() != 0;
+        break;
+      case LogField::Type::str:
+        f.s = r.bytes(r.num<uint32_t>());
+        break;
+      case LogField::Type::strs: {
+        uint32_t n = r.num<uint32_t>();
+        f.list.clear();
+        for (uint32_t k = 0; k < n && r.ok; k++) {
+          f.list.emplace_back(r.bytes(r.num<uint32_t>()));
+        }
+        break;
+      }
+      default:
+        return false;
+      }
+      if (!r.ok) {
+        return false;
+      }
+    }
+    if (!r.ok || r.p != r.end) {
+      return false;
+    }
+    emit(static_cast<time_t>(ts), event, out);
+    return true;
+  }
+
+  // back through LogEncoder, so text and JSON match what the logger
+  // writes in those formats
+  void emit(time_t ts, std::string_view event, std::string &out) {
+    std::vector<LogField> fields;
+    fields.reserve(fields_.size());
+    for (const Field &f : fields_) {
+      switch (f.type) {
+      case LogField::Type::i64:
+        fields.emplace_back(f.key, f.i);
+        break;
+      case LogField::Type::u64:
+        fields.emplace_back(f.key, f.u);
+        break;
+      case LogField::Type::f64:
+        fields.emplace_back(f.key, f.d);
+        break;
+      case LogField::Type::boolean:
+        fields.emplace_back(f.key, f.b);
+        break;
+      case LogField::Type::str:
+        fields.emplace_back(f.key, f.s);
+        break;
+      case LogField::Type::strs:
+        fields.emplace_back(f.key, f.list);
+        break;
+      }
+    }
+    LogFields list(fields);
+    if (to_ == LogFormat::json) {
+      LogEncoder::json(out, ts, event, list);
+      return;
+    }
+    char prefix[64];
+    std::tm tm;
+    localtime_r(&ts, &tm);
+    size_t n = strftime(prefix, sizeof(prefix), "%D %r %Z ", &tm);
+    if (event.empty() && fields.size() == 1 && fields[0].key == "msg" &&
+        fields[0].type == LogField::Type::str) {
+      out.append(prefix, n);
+      out.append(fields[0].s);
+      out.push_back('\n');
+      return;
+    }
+    LogEncoder::text(out, std::string_view(prefix, n), event, list);
+  }
+
+  LogFormat to_;
+  std::vector<Field> fields_;
+  uint64_t records_ = 0;
+  uint64_t skipped_ = 0;
+};
@@ -1,21 +1,176 @@
 #include <iostream>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <fcntl.h>
 #include <filesystem>
 #include <fstream>
 #include <iomanip>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <pthread.h>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 #include <zlib.h>
 
+#include "log_format.hpp"
+
+// Bounded lock-free queue of log records: any number of producers, one
+// consumer (the async writer).  Each slot carries a sequence number that
+// says whether it is free for the producer at that position or holds a
+// record for the consumer.
+class LogRing {
+  struct Slot {
+    std::atomic<size_t> seq;
+    std::string record;
+  };
+  std::unique_ptr<Slot[]> slots;
+  size_t mask;
+  alignas(64) std::atomic<size_t> head{0}; // next position to claim
+  alignas(64) std::atomic<size_t> tail{0}; // next position to consume
+
+public:
+  // capacity is rounded up to a power of two
+  explicit LogRing(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    slots = std::make_unique<Slot[]>(size);
+    for (size_t i = 0; i < size; i++) {
+      slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+    mask = size - 1;
+  }
+
+  // moves record in; false (record untouched) when the ring is full
+  bool tryPush(std::string &record) {
+    size_t pos = head.load(std::memory_order_relaxed);
+    for (;;) {
+      Slot &slot = slots[pos & mask];
+      size_t seq = slot.seq.load(std::memory_order_acquire);
+      intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (dif == 0) {
+        if (head.compare_exchange_weak(pos, pos + 1,
+                                       std::memory_order_relaxed)) {
+          slot.record = std::move(record);
+          slot.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (dif < 0) {
+        return false;
+      } else {
+        pos = head.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // consumer only
+  bool tryPop(std::string &record) {
+    size_t pos = tail.load(std::memory_order_relaxed);
+    Slot &slot = slots[pos & mask];
+    if (slot.seq.load(std::memory_order_acquire) != pos + 1) {
+      return false; // empty, or the producer is still copying
+    }
+    record = std::move(slot.record);
+    slot.seq.store(pos + mask + 1, std::memory_order_release);
+    tail.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t claimed() const { return head.load(std::memory_order_acquire); }
+  size_t consumed() const { return tail.load(std::memory_order_acquire); }
+  size_t capacity() const { return mask + 1; }
+};
+
+// When the log is rotated and how many rotated files are kept.  A file is
+// rotated at the first of its limits it reaches; 0 turns a limit off.
+struct RotationPolicy {
+  enum class Period { none, hourly, daily };
+  Period period = Period::daily;    // rotate when the hour or date changes
+  uint64_t max_bytes = 0;           // rotate once the file is this large
+  std::chrono::seconds max_age{0};  // rotate once the file is this old
+  int keep_files = 0;               // rotated files kept, newest first
+  int keep_days = 10;               // rotated files older than this go
+
+  static std::optional<Period> parsePeriod(const std::string &name) {
+    if (name == "daily") {
+      return Period::daily;
+    }
+    if (name == "hourly") {
+      return Period::hourly;
+    }
+    if (name == "none") {
+      return Period::none;
+    }
+    return std::nullopt;
+  }
+};
+
 class Logger {
   std::string filename;    // the name of the file to write to
   std::ofstream file;      // the file stream object
   std::string lastLogDate; // the date of the last log entry
   std::mutex log_mtx;
   int hour_of_day;        // last hour of day
-  bool hourly;            // flag to handle date change to hourly
+  RotationPolicy policy;
+  // bytes in the current file, counted as they are written: the size
+  // limit costs no stat() per line
+  uint64_t file_bytes = 0;
+  time_t file_opened = 0;   // when the current file was started
+  std::atomic<bool> rotate_requested{false}; // rotateNow() in async mode
+  LogFormat format = LogFormat::text;
+
+  // async mode: producers format and queue, the writer thread writes
+  std::unique_ptr<LogRing> ring;
+  std::thread writer;
+  std::atomic<std::thread::id> writer_id{};
+  int async_fd = -1;
+  std::atomic<bool> async_on{false};
+  std::atomic<int> producers{0}; // threads inside enqueue()
+  std::atomic<bool> wake{false};
+  bool writer_stop = false;
+  std::chrono::milliseconds flush_interval{200};
+  std::mutex writer_mtx;
+  std::condition_variable writer_cv;
+  std::condition_variable flushed_cv;
+  std::atomic<uint64_t> full_waits{0}; // records that waited for room
+  bool cache_stamps = true; // reuse a thread's timestamp within a second
+
+  // rotation worker: compresses rotated files and prunes old ones, off
+  // the logging path
+  std::thread rotator;
+  std::mutex rotate_mtx;
+  std::condition_variable rotate_cv;
+  std::deque<std::string> rotate_jobs; // rotated files to compress
+  size_t rotate_busy = 0;              // jobs taken, not finished
+  bool rotate_stop = false;
+  std::atomic<int> compress_level{Z_DEFAULT_COMPRESSION};
+
+  // The line prefix and the rotation date and hour of one second, kept per
+  // thread so no thread waits on another (or on libc's timezone lock) to
+  // format a timestamp.
+  struct Stamp {
+    time_t second = -1;
+    char prefix[64];       // "%D %r %Z "
+    size_t prefix_len = 0;
+    char date[16];         // "%Y-%m-%d"
+    int hour = 0;
+  };
 
 public:
   // constructor that takes the file name as a parameter and opens the file
@@ -25,21 +180,124 @@ public:
       throw std::runtime_error("Failed to open file " + fname);
     }
     // Initialize lastLogDate with the current date
-    lastLogDate = getCurrentDate();
-
-    hourly = false;   // set true for test
+    const Stamp &now = stamp();
+    lastLogDate = now.date;
+    hour_of_day = now.hour;
+    file_opened = now.second;
+    // appending to an existing file: the one stat() the counter needs
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size(filename, ec);
+    file_bytes = ec ? 0 : size;
   }
 
-  // destructor that closes the file
-  ~Logger() { file.close(); }
+  // destructor that closes the file; queued records are written first
+  ~Logger() {
+    stopAsync();
+    stopRotation();
+    file.close();
+  }
 
   // method that takes a message as a parameter and writes it to the file with a
   // timestamp
   void log(const std::string &message) {
+    if (async_on.load(std::memory_order_acquire)) {
+      enqueue(formatRecord(message));
+      return;
+    }
     std::lock_guard<std::mutex> lock(log_mtx);
     handleDateChange();
     logMessageWithTimestamp(message);
   }
+
+  // Structured record: typed fields, encoded in the log's format straight
+  // into a per-thread buffer, without building the line from strings.
+  void event(std::string_view name, std::initializer_list<LogField> fields) {
+    if (async_on.load(std::memory_order_acquire)) {
+      std::string &buf = scratch();
+      encodeEvent(buf, name, fields);
+      enqueue(std::string(buf));
+      return;
+    }
+    std::lock_guard<std::mutex> lock(log_mtx);
+    handleDateChange();
+    std::string &buf = scratch();
+    encodeEvent(buf, name, fields);
+    writeSync(buf);
+  }
+
+  // text, json (one object per line) or binary (see LogEncoder); set
+  // before startAsync()
+  void setFormat(LogFormat f) {
+    std::lock_guard<std::mutex> lock(log_mtx);
+    format = f;
+  }
+
+  // Async mode: log() formats the record and queues it on a lock-free ring
+  // of queue_size records; a writer thread writes what has queued up with
+  // one writev() at least every flush_ms, sooner when the ring fills up.
+  // When the ring is full producers wait, records are not dropped.
+  void startAsync(size_t queue_size, std::chrono::milliseconds flush_ms) {
+    std::lock_guard<std::mutex> lock(log_mtx);
+    if (async_on) {
+      return;
+    }
+    file.flush();
+    int fd = ::open(filename.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+                    0644);
+    if (fd < 0) {
+      throw std::runtime_error("Failed to open file " + filename);
+    }
+    file.close();
+    async_fd = fd;
+    ring = std::make_unique<LogRing>(queue_size > 0 ? queue_size : 1);
+    flush_interval = flush_ms.count() > 0 ? flush_ms
+                                          : std::chrono::milliseconds(1);
+    writer_stop = false;
+    writer = std::thread(&Logger::writeLoop, this);
+    async_on.store(true, std::memory_order_release);
+  }
+
+  // Writes everything queued and returns to synchronous logging.  Called
+  // on shutdown; safe to call when async mode is off.
+  void stopAsync() {
+    // synchronous writers wait here until the file is back
+    std::lock_guard<std::mutex> lock(log_mtx);
+    if (!async_on.exchange(false)) {
+      return;
+    }
+    while (producers.load() > 0) {
+      std::this_thread::yield();
+    }
+    {
+      std::lock_guard<std::mutex> wlock(writer_mtx);
+      writer_stop = true;
+    }
+    writer_cv.notify_one();
+    writer.join();
+    ::close(async_fd);
+    async_fd = -1;
+    file.open(filename, std::ios::out | std::ios::app);
+  }
+
+  // Returns once everything logged so far is in the file.
+  void flush() {
+    if (!async_on.load(std::memory_order_acquire)) {
+      std::lock_guard<std::mutex> lock(log_mtx);
+      file.flush();
+      return;
+    }
+    size_t target = ring->claimed();
+    std::unique_lock<std::mutex> lock(writer_mtx);
+    wake = true;
+    writer_cv.notify_one();
+    flushed_cv.wait(lock, [&] { return ring->consumed() >= target; });
+  }
+
+  // Off formats every timestamp from scratch; for benchmarks.
+  void setTimestampCache(bool on) { cache_stamps = on; }
+
+  bool isAsync() const { return async_on.load(); }
+  uint64_t fullWaits() const { return full_waits.load(); }
   // internal log - no mutex no date change
   void ilog(const std::string &message) {
     logMessageWithTimestamp(message);
@@ -49,6 +307,14 @@ public:
   // New method to handle multiline input and log each line with a timestamp
   // prefix
   void logMultiline(const std::string &multilineInput) {
+    if (async_on.load(std::memory_order_acquire)) {
+      std::istringstream iss(multilineInput);
+      std::string line;
+      while (std::getline(iss, line)) {
+        enqueue(formatRecord(line));
+      }
+      return;
+    }
     std::lock_guard<std::mutex> lock(log_mtx);
     handleDateChange();
     std::istringstream iss(multilineInput);
@@ -58,89 +324,156 @@ public:
     }
    }
 
+  // Set before startAsync(); the writer thread reads it unlocked.
+  void setRotationPolicy(const RotationPolicy &p) {
+    std::lock_guard<std::mutex> lock(log_mtx);
+    policy = p;
+  }
+
+  uint64_t currentFileBytes() {
+    std::lock_guard<std::mutex> lock(log_mtx);
+    return file_bytes;
+  }
+
+  // zlib level for rotated files: 1 (fastest) .. 9 (smallest), or
+  // Z_DEFAULT_COMPRESSION
+  void setCompressionLevel(int level) {
+    compress_level = (level >= 1 && level <= 9) ? level : Z_DEFAULT_COMPRESSION;
+  }
+
+  // Rotates the file now, as a date change would.
+  void rotateNow() {
+    if (async_on.load(std::memory_order_acquire)) {
+      // the writer owns the fd: it rotates after what is queued now
+      size_t target = ring->claimed();
+      std::unique_lock<std::mutex> lock(writer_mtx);
+      rotate_requested = true;
+      wake = true;
+      writer_cv.notify_one();
+      flushed_cv.wait(lock, [&] {
+        return !rotate_requested.load() && ring->consumed() >= target;
+      });
+      return;
+    }
+    std::lock_guard<std::mutex> lock(log_mtx);
+    zip_and_rotate();
+  }
+
+  // Returns once every rotated file is compressed and the prune is done.
+  void waitRotation() {
+    std::unique_lock<std::mutex> lock(rotate_mtx);
+    rotate_cv.wait(lock, [&] { return rotate_jobs.empty() && rotate_busy == 0; });
+  }
+
   // Public method to allow testing of deleteOldFiles
   void testDeleteOldFiles(const std::string &directory, int daysOld) {
-    deleteOldFiles(directory, daysOld);
+    deleteOldFiles(directory, 0, daysOld);
   }
 
 private:
-  // Helper method to get the current date as a string
-  std::string getCurrentDate() {
-    auto time = std::chrono::system_clock::now();
-    time_t tt = std::chrono::system_clock::to_time_t(time);
-    std::tm tm = *std::localtime(&tt);
-    std::ostringstream oss;
-    oss << std::put_time(&tm, "%Y-%m-%d");
-    return oss.str();
+  // This thread's stamp for the current second; localtime_r and strftime
+  // run once per second per thread.
+  const Stamp &stamp() {
+    thread_local Stamp cached;
+    time_t now = std::chrono::system_clock::to_time_t(
+        std::chrono::system_clock::now());
+    if (now != cached.second || !cache_stamps) {
+      std::tm tm;
+      localtime_r(&now, &tm);
+      cached.prefix_len =
+          strftime(cached.prefix, sizeof(cached.prefix), "%D %r %Z ", &tm);
+      strftime(cached.date, sizeof(cached.date), "%Y-%m-%d", &tm);
+      cached.hour = tm.tm_hour;
+      cached.second = now;
+    }
+    return cached;
   }
+
+  // Helper method to get the current date as a string
+  std::string getCurrentDate() { return stamp().date; }
   //////
   // New method to get the current hour of the day
   // for testing.
   //////////////////////
   int getHourOfDay() {
-    auto now = std::chrono::system_clock::now();
-    std::time_t tt = std::chrono::system_clock::to_time_t(now);
-    std::tm localTime = *std::localtime(&tt); // Convert to local time
-
-    return localTime.tm_hour; // Return the hour (0-23)
+    return stamp().hour; // Return the hour (0-23)
   }
 
+  // Compresses into filename.gz through a temporary file, so a crash
+  // leaves either the plain file or a whole .gz, never half of one.
   void gzipFile(const std::string &filename) {
+    constexpr size_t kBuffer = 256 * 1024;
     std::string gzFilename = filename + ".gz";
-    gzFile gzFile = gzopen(gzFilename.c_str(), "wb");
+    std::string tmpFilename = gzFilename + ".tmp";
+    int level = compress_level.load();
+    std::string mode = (level == Z_DEFAULT_COMPRESSION)
+                           ? std::string("wb")
+                           : "wb" + std::to_string(level);
+    gzFile gzFile = gzopen(tmpFilename.c_str(), mode.c_str());
     if (!gzFile) {
-      throw std::runtime_error("Failed to open gzip file " + gzFilename);
+      throw std::runtime_error("Failed to open gzip file " + tmpFilename);
     }
+    gzbuffer(gzFile, kBuffer);
 
-    std::ifstream inFile(filename, std::ios::binary);
-    if (!inFile) {
+    int in = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
       gzclose(gzFile);
+      std::filesystem::remove(tmpFilename);
       throw std::runtime_error("Failed to open file " + filename);
     }
 
-    char buffer[1024];
-    while (inFile.read(buffer, sizeof(buffer))) {
-      gzwrite(gzFile, buffer, inFile.gcount());
+    std::vector<char> buffer(kBuffer);
+    ssize_t n;
+    bool ok = true;
+    while ((n = ::read(in, buffer.data(), buffer.size())) > 0) {
+      if (gzwrite(gzFile, buffer.data(), static_cast<unsigned>(n)) != n) {
+        ok = false;
+        break;
+      }
     }
-    gzwrite(gzFile, buffer, inFile.gcount()); // Write any remaining data
-
-    inFile.close();
-    gzclose(gzFile);
+    ::close(in);
+    if (gzclose(gzFile) != Z_OK || n < 0 || !ok) {
+      std::filesystem::remove(tmpFilename);
+      throw std::runtime_error("Failed to compress " + filename);
+    }
+    std::filesystem::rename(tmpFilename, gzFilename);
 
     // Remove the original file after gzipping
     std::filesystem::remove(filename);
    }
 
-  // Function to delete files older than a specified number of days
-  void deleteOldFiles(const std::string &directory, int daysOld) {
-    auto now = std::chrono::system_clock::now();
-    std::string prefix = filename; // Get the filename prefix
-    std::cout << "logger internal: ... starting delete older files older than " << daysOld << " days old" << std::endl;
-    std::cout << "logger internal: delete file prefix - " << prefix << std::endl;
-    ilog("logger internal:  ... starting delete older files older than " + std::to_string(daysOld) + " days old");
-    ilog("logger internal:  delete file prefix - " + prefix );
+  // Deletes rotated files ("<log name>.*") in directory beyond the newest
+  // keepFiles and those older than daysOld days; 0 turns either off.
+  void deleteOldFiles(const std::string &directory, int keepFiles, int daysOld) {
+    auto now = std::filesystem::file_time_type::clock::now();
+    std::string prefix =
+        std::filesystem::path(filename).filename().string() + ".";
+    std::vector<std::pair<std::filesystem::file_time_type,
+                          std::filesystem::path>> rotated;
     for (const auto &entry : std::filesystem::directory_iterator(directory)) {
-      if (entry.is_regular_file()) { // Ensure it's a regular file
-        auto fileName = entry.path().filename().string();
-        // log("logger internal : file prefix match - " + entry.path().filename().string() );
-        // Check if the file starts with the prefix 
-        if (fileName.rfind(prefix, 0) == 0 ) {
-          auto fileTime = std::filesystem::last_write_time(entry);
-          auto sctp =
-              std::chrono::time_point_cast<std::chrono::system_clock::duration>(
-                  fileTime - std::filesystem::file_time_type::clock::now() +
-                  std::chrono::system_clock::now());
-          auto fileAge =
-              std::chrono::duration_cast<std::chrono::hours>(now - sctp).count() /
-              24;
-          std::cout << "logger internal: prefix match - " << entry.path().filename().string() << std::endl;
-          ilog("logger internal: prefix match - " + entry.path().filename().string()); 
-          if (fileAge > daysOld) {
-            ilog("logger internal: removing - " + entry.path().string());
-            std::cout << "removing: " << entry << std::endl;
-            std::filesystem::remove(entry);
-          }
-        }
+      if (!entry.is_regular_file()) { // Ensure it's a regular file
+        continue;
+      }
+      auto fileName = entry.path().filename().string();
+      // Check if the file starts with the prefix; skip a compression
+      // still in progress
+      if (fileName.rfind(prefix, 0) != 0 ||
+          (fileName.size() > 4 &&
+           fileName.compare(fileName.size() - 4, 4, ".tmp") == 0)) {
+        continue;
+      }
+      rotated.emplace_back(entry.last_write_time(), entry.path());
+    }
+    std::sort(rotated.begin(), rotated.end(),
+              [](const auto &a, const auto &b) { return a.first > b.first; });
+    for (size_t i = 0; i < rotated.size(); i++) {
+      auto fileAge = std::chrono::duration_cast<std::chrono::hours>(
+                         now - rotated[i].first).count() / 24;
+      bool tooMany = keepFiles > 0 && i >= static_cast<size_t>(keepFiles);
+      bool tooOld = daysOld > 0 && fileAge > daysOld;
+      if (tooMany || tooOld) {
+        log("logger internal: removing - " + rotated[i].second.string());
+        std::filesystem::remove(rotated[i].second);
       }
     }
   }
@@ -148,60 +481,323 @@ private:
 // New function to handle file renaming, gzipping, and opening a new log file
 void zip_and_rotate() {
     // Close the current file
-    file.close();
+    if (async_fd >= 0) {
+        ::close(async_fd);
+    } else {
+        file.close();
+    }
 
-    // Rename the file to include the date
-    std::string newFilename = filename + "." + lastLogDate;
+    // Rename the file to include the date (and hour, rotating hourly);
+    // rename(2) is atomic, and a second rotation in the same period gets
+    // its own name
+    std::string stem = filename + "." + lastLogDate;
+    if (policy.period == RotationPolicy::Period::hourly) {
+        char hour[4];
+        snprintf(hour, sizeof(hour), "%02d", hour_of_day);
+        stem += std::string("-") + hour;
+    }
+    std::string newFilename = stem;
+    for (int i = 1; std::filesystem::exists(newFilename) ||
+                    std::filesystem::exists(newFilename + ".gz");
+         i++) {
+        newFilename = stem + "." + std::to_string(i);
+    }
     std::filesystem::rename(filename, newFilename);
-
-    // Gzip the renamed file
-    gzipFile(newFilename);
+    file_bytes = 0;
+    file_opened = stamp().second;
 
     // Open a new file for logging
-    file.open(filename, std::ios::out | std::ios::app);
-    if (!file) {
-        throw std::runtime_error("Failed to open file " + filename);
+    if (async_fd >= 0) {
+        async_fd = ::open(filename.c_str(),
+                          O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        if (async_fd < 0) {
+            throw std::runtime_error("Failed to open file " + filename);
+        }
+    } else {
+        file.open(filename, std::ios::out | std::ios::app);
+        if (!file) {
+            throw std::runtime_error("Failed to open file " + filename);
+        }
     }
 
-    // Delete old files
-    deleteOldFiles(".", 10);
+    // Gzip the renamed file and delete old files, on the rotation worker
+    scheduleCompress(newFilename);
 }
 
+void scheduleCompress(const std::string &path) {
+    std::lock_guard<std::mutex> lock(rotate_mtx);
+    if (!rotator.joinable()) {
+        rotator = std::thread(&Logger::rotateLoop, this);
+    }
+    rotate_jobs.push_back(path);
+    rotate_cv.notify_all();
+}
 
+void rotateLoop() {
+    // like the writer, leave signals to the program's threads
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, nullptr);
+    std::unique_lock<std::mutex> lock(rotate_mtx);
+    for (;;) {
+        rotate_cv.wait(lock, [&] { return rotate_stop || !rotate_jobs.empty(); });
+        if (rotate_jobs.empty()) {
+            return; // stopping
+        }
+        std::string path = std::move(rotate_jobs.front());
+        rotate_jobs.pop_front();
+        ++rotate_busy;
+        lock.unlock();
+        try {
+            gzipFile(path);
+        } catch (const std::exception &e) {
+            log(std::string("logger internal: ") + e.what());
+        }
+        try {
+            std::filesystem::path dir = std::filesystem::path(filename).parent_path();
+            deleteOldFiles(dir.empty() ? "." : dir.string(), policy.keep_files,
+                           policy.keep_days);
+        } catch (const std::exception &e) {
+            log(std::string("logger internal: prune failed: ") + e.what());
+        }
+        lock.lock();
+        --rotate_busy;
+        rotate_cv.notify_all();
+    }
+}
+
+// Finishes the queued compressions, then stops the worker.
+void stopRotation() {
+    {
+        std::lock_guard<std::mutex> lock(rotate_mtx);
+        rotate_stop = true;
+    }
+    rotate_cv.notify_all();
+    if (rotator.joinable()) {
+        rotator.join();
+    }
+}
 
-void handleDateChange() {
 
-    // Get the current date
-    std::string currentDate = getCurrentDate();
-    int currentHour = getHourOfDay();
-    if (hourly == true){
-         if (hour_of_day != currentHour ) {
-             zip_and_rotate();
-         }
-         hour_of_day = currentHour;
-         return;
-    } 
-    // Check if the date has changed
-    if (currentDate != lastLogDate) {
-        zip_and_rotate();  // Call the new zip_and_rotate function
-        lastLogDate = currentDate;  // Update the last log date
-    }
-    hour_of_day = currentHour;
+
+// Rotates when the policy says the current file is done: its hour or
+// date is over, or it reached max_bytes or max_age.
+void handleDateChange() {
+    const Stamp &now = stamp();
+    bool newDate = lastLogDate != now.date;
+    bool rotate = false;
+    switch (policy.period) {
+    case RotationPolicy::Period::hourly:
+        rotate = rotate || newDate || hour_of_day != now.hour;
+        break;
+    case RotationPolicy::Period::daily:
+        rotate = rotate || newDate;
+        break;
+    case RotationPolicy::Period::none:
+        break;
+    }
+    if (policy.max_bytes > 0 && file_bytes >= policy.max_bytes) {
+        rotate = true;
+    }
+    if (policy.max_age.count() > 0 &&
+        now.second - file_opened >= policy.max_age.count()) {
+        rotate = true;
+    }
+    if (rotate) {
+        std::string currentDate = now.date; // zip_and_rotate logs, which
+        int currentHour = now.hour;         // may move on to a new second
+        zip_and_rotate();
+        lastLogDate = currentDate;
+        hour_of_day = currentHour;
+    } else {
+        if (newDate) {
+            lastLogDate = now.date; // period none: names still get the date
+        }
+        hour_of_day = now.hour;
+    }
 }
 
 
 
   // Helper method to log a message with a timestamp
   void logMessageWithTimestamp(const std::string &message) {
-    // Get the current time
-    auto time = std::chrono::system_clock::now();
-    time_t tt = std::chrono::system_clock::to_time_t(time);
-    std::tm tm = *std::localtime(&tt);
-
+    if (std::this_thread::get_id() == writer_id.load()) {
+      std::string record = formatRecord(message); // ilog from a rotation
+      writeRecords(&record, 1);
+      return;
+    }
+    if (async_on.load(std::memory_order_acquire)) {
+      enqueue(formatRecord(message));
+      return;
+    }
+    if (format != LogFormat::text) {
+      std::string &buf = scratch();
+      LogField msg("msg", message);
+      encodeEvent(buf, "", LogFields(&msg, 1));
+      writeSync(buf);
+      return;
+    }
     // Write the formatted time and date and the message to the file, separated
     // by a space
-    file << std::put_time(&tm, "%D %r %Z") << " " << message << "\n";
+    const Stamp &now = stamp();
+    file.write(now.prefix, now.prefix_len);
+    file << message << "\n";
+    file.flush();
+    file_bytes += now.prefix_len + message.size() + 1;
+  }
+
+  // cleared, with the capacity of this thread's earlier records
+  static std::string &scratch() {
+    thread_local std::string buf;
+    buf.clear();
+    return buf;
+  }
+
+  void encodeEvent(std::string &out, std::string_view name, LogFields fields) {
+    const Stamp &now = stamp();
+    switch (format) {
+    case LogFormat::text:
+      LogEncoder::text(out, std::string_view(now.prefix, now.prefix_len), name,
+                       fields);
+      break;
+    case LogFormat::json:
+      LogEncoder::json(out, now.second, name, fields);
+      break;
+    case LogFormat::binary:
+      LogEncoder::binary(out, now.second, name, fields);
+      break;
+    }
+  }
+
+  void writeSync(const std::string &record) {
+    file.write(record.data(), record.size());
     file.flush();
+    file_bytes += record.size();
+  }
+
+  // "%D %r %Z message\n", as logMessageWithTimestamp writes it
+  std::string formatRecord(const std::string &message) {
+    if (format != LogFormat::text) {
+      std::string &buf = scratch();
+      LogField msg("msg", message);
+      encodeEvent(buf, "", LogFields(&msg, 1));
+      return buf;
+    }
+    const Stamp &now = stamp();
+    std::string record;
+    record.reserve(now.prefix_len + message.size() + 1);
+    record.append(now.prefix, now.prefix_len);
+    record.append(message);
+    record.push_back('\n');
+    return record;
+  }
+
+  void enqueue(std::string record) {
+    producers.fetch_add(1);
+    if (!async_on.load(std::memory_order_acquire)) {
+      // stopAsync() is draining; the file is being handed back
+      producers.fetch_sub(1);
+      std::lock_guard<std::mutex> lock(log_mtx);
+      file << record;
+      file.flush();
+      file_bytes += record.size();
+      return;
+    }
+    if (!ring->tryPush(record)) {
+      if (std::this_thread::get_id() == writer_id.load()) {
+        writeRecords(&record, 1); // the writer cannot wait for itself
+      } else {
+        full_waits.fetch_add(1, std::memory_order_relaxed);
+        wakeWriter();
+        while (!ring->tryPush(record)) {
+          std::this_thread::yield();
+        }
+      }
+    } else if (ring->claimed() - ring->consumed() > ring->capacity() / 2) {
+      wakeWriter();
+    }
+    producers.fetch_sub(1);
+  }
+
+  void wakeWriter() {
+    if (!wake.exchange(true)) {
+      writer_cv.notify_one();
+    }
+  }
+
+  void writeLoop() {
+    // signals belong to the program's threads: with SIGTERM left open here
+    // the writer could take it and the process die with records queued
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, nullptr);
+    writer_id = std::this_thread::get_id();
+    std::vector<std::string> batch;
+    batch.reserve(IOV_MAX);
+    for (;;) {
+      bool stopping;
+      {
+        std::unique_lock<std::mutex> lock(writer_mtx);
+        writer_cv.wait_for(lock, flush_interval,
+                           [&] { return writer_stop || wake.load(); });
+        wake = false;
+        stopping = writer_stop;
+      }
+      std::string record;
+      do {
+        batch.clear();
+        while (batch.size() < IOV_MAX && ring->tryPop(record)) {
+          batch.push_back(std::move(record));
+        }
+        if (!batch.empty()) {
+          handleDateChange();
+          writeRecords(batch.data(), batch.size());
+        }
+      } while (batch.size() == IOV_MAX);
+      if (rotate_requested.exchange(false)) {
+        zip_and_rotate(); // rotateNow(), after what it found queued
+      }
+      {
+        // a flush() between its check and its wait must not miss this
+        std::lock_guard<std::mutex> lock(writer_mtx);
+      }
+      flushed_cv.notify_all();
+      if (stopping && ring->consumed() == ring->claimed()) {
+        writer_id = std::thread::id();
+        return;
+      }
+    }
+  }
+
+  // one writev() for the lot, repeated for what a short write left
+  void writeRecords(std::string *records, size_t count) {
+    std::vector<struct iovec> iov(count);
+    for (size_t i = 0; i < count; i++) {
+      iov[i].iov_base = records[i].data();
+      iov[i].iov_len = records[i].size();
+      file_bytes += records[i].size();
+    }
+    struct iovec *next = iov.data();
+    int left = static_cast<int>(count);
+    while (left > 0) {
+      ssize_t n = ::writev(async_fd, next, left);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        std::cerr << "logger: write failed: " << strerror(errno) << std::endl;
+        return;
+      }
+      while (left > 0 && static_cast<size_t>(n) >= next->iov_len) {
+        n -= next->iov_len;
+        ++next;
+        --left;
+      }
+      if (left > 0) {
+        next->iov_base = static_cast<char *>(next->iov_base) + n;
+        next->iov_len -= n;
+      }
+    }
   }
 };
 
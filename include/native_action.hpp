@@ -0,0 +1,451 @@
+#pragma once
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cctype>
+#include <cerrno>
+#include <cstddef>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <optional>
+#include <spawn.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+extern char **environ;
+
+/**
+ * @class NativeAction
+ * @brief A reaction the daemon carries out itself instead of running a
+ * script: signal the matched process, restart a command, append a line to
+ * a file, touch a file, or send a datagram over UDP or a unix socket.
+ *
+ * Only restart starts a process (with posix_spawn, detached in its own
+ * process group); the others are a system call or two.  Throttling works
+ * as in ShellScriptExecutor::execute().  Everything that can be checked
+ * (signal names, addresses, the command) is resolved when the action is
+ * built, so a bad [script] entry fails at startup.
+ *
+ * Messages may contain {watch}, {pid} and {state}, filled in per event.
+ */
+class NativeAction {
+public:
+  enum class Kind { signal, restart, append, touch, notify };
+
+  // What the action is reacting to.
+  struct Event {
+    std::string watch;
+    int pid = -1; // the matched process, -1 when none matched
+    bool found = false;
+  };
+
+  static std::optional<Kind> parseKind(const std::string &name) {
+    static const std::pair<const char *, Kind> kinds[] = {
+        {"signal", Kind::signal}, {"restart", Kind::restart},
+        {"append", Kind::append}, {"touch", Kind::touch},
+        {"notify", Kind::notify}};
+    for (const auto &k : kinds) {
+      if (name == k.first) {
+        return k.second;
+      }
+    }
+    return std::nullopt;
+  }
+
+  // "TERM", "SIGTERM" or "15"
+  static std::optional<int> parseSignal(std::string name) {
+    static const std::pair<const char *, int> signals[] = {
+        {"HUP", SIGHUP},   {"INT", SIGINT},   {"QUIT", SIGQUIT},
+        {"KILL", SIGKILL}, {"TERM", SIGTERM}, {"USR1", SIGUSR1},
+        {"USR2", SIGUSR2}, {"STOP", SIGSTOP}, {"CONT", SIGCONT}};
+    if (name.compare(0, 3, "SIG") == 0) {
+      name = name.substr(3);
+    }
+    for (const auto &s : signals) {
+      if (name == s.first) {
+        return s.second;
+      }
+    }
+    // NSIG is below 100, so longer digit strings cannot be signals (and
+    // would overflow stoi)
+    if (!name.empty() && name.size() <= 3 &&
+        std::all_of(name.begin(), name.end(), ::isdigit)) {
+      int sig = std::stoi(name);
+      if (sig > 0 && sig < NSIG) {
+        return sig;
+      }
+    }
+    return std::nullopt;
+  }
+
+  /**
+   * @brief Signal the matched process.
+   * @throws std::invalid_argument for an unknown signal.
+   */
+  static NativeAction signal(const std::string &name, int time_throttle) {
+    NativeAction a(Kind::signal, time_throttle);
+    auto sig = parseSignal(name);
+    if (!sig) {
+      throw std::invalid_argument("unknown signal " + name);
+    }
+    a.signal_ = *sig;
+    a.target_ = name;
+    return a;
+  }
+
+  /**
+   * @brief Start argv[0] (searched in PATH) with the rest as arguments.
+   * @throws std::invalid_argument if argv is empty or argv[0] is not an
+   * executable file.
+   */
+  static NativeAction restart(const std::vector<std::string> &argv,
+                              int time_throttle) {
+    if (argv.empty() || argv[0].empty()) {
+      throw std::invalid_argument("restart needs a command");
+    }
+    auto path = findExecutable(argv[0]);
+    if (!path) {
+      throw std::invalid_argument("restart command " + argv[0] +
+                                  " not found or not executable");
+    }
+    NativeAction a(Kind::restart, time_throttle);
+    a.argv_ = argv;
+    a.path_ = *path;
+    a.target_ = argv[0];
+    return a;
+  }
+
+  // Append message and a newline to path, creating it if needed.
+  static NativeAction append(const std::string &path,
+                             const std::string &message, int time_throttle) {
+    if (path.empty()) {
+      throw std::invalid_argument("append needs a file");
+    }
+    NativeAction a(Kind::append, time_throttle);
+    a.target_ = path;
+    a.message_ = message;
+    return a;
+  }
+
+  // Create path or set its times to now, e.g. a heartbeat file.
+  static NativeAction touch(const std::string &path, int time_throttle) {
+    if (path.empty()) {
+      throw std::invalid_argument("touch needs a file");
+    }
+    NativeAction a(Kind::touch, time_throttle);
+    a.target_ = path;
+    return a;
+  }
+
+  /**
+   * @brief Send message as one datagram to "udp:host:port" or
+   * "unix:/path".  The host is resolved here, once.
+   * @throws std::invalid_argument for a target that does not resolve.
+   */
+  static NativeAction notify(const std::string &target,
+                             const std::string &message, int time_throttle) {
+    NativeAction a(Kind::notify, time_throttle);
+    a.target_ = target;
+    a.message_ = message;
+    a.addr_ = std::make_shared<Address>(resolve(target));
+    return a;
+  }
+
+  Kind kind() const { return kind_; }
+
+  std::string describe() const {
+    static const char *names[] = {"signal", "restart", "append", "touch",
+                                  "notify"};
+    return std::string(names[static_cast<int>(kind_)]) + " " + target_;
+  }
+
+  /**
+   * @brief Carries out the action if throttle conditions are met.
+   * @return What was done, or a message indicating throttle conditions.
+   * @throws std::runtime_error if the action failed.
+   */
+  std::string execute(const Event &event) {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    auto now_seconds =
+        std::chrono::duration_cast<std::chrono::seconds>(now).count();
+
+    if (time_last_executed_ != 0 &&
+        now_seconds < time_last_executed_ + time_throttle_) {
+      return "Throttle time not reached. Action not executed.";
+    }
+    time_last_executed_ = now_seconds;
+    switch (kind_) {
+    case Kind::signal:
+      return sendSignal(event);
+    case Kind::restart:
+      return spawnDetached();
+    case Kind::append:
+      return appendLine(event);
+    case Kind::touch:
+      return touchFile();
+    case Kind::notify:
+      return sendDatagram(event);
+    }
+    return "";
+  }
+
+  /**
+   * @brief Reaps restarted commands that have exited.  The daemon has no
+   * SIGCHLD reaper (script runs wait for their own child), so main calls
+   * this on SIGCHLD.
+   */
+  static void reapRestarted() {
+    std::lock_guard<std::mutex> lock(restartedMutex());
+    auto &pids = restarted();
+    pids.erase(std::remove_if(pids.begin(), pids.end(),
+                              [](pid_t pid) {
+                                return ::waitpid(pid, nullptr, WNOHANG) != 0;
+                              }),
+               pids.end());
+  }
+
+private:
+  struct Address {
+    struct sockaddr_storage addr;
+    socklen_t len;
+  };
+
+  NativeAction(Kind kind, int time_throttle)
+      : kind_(kind), time_throttle_(time_throttle) {}
+
+  // name itself if it contains a slash, else the first PATH entry holding
+  // it, as execvp would pick; only regular files we may execute count
+  static std::optional<std::string> findExecutable(const std::string &name) {
+    auto usable = [](const std::string &path) {
+      struct stat st;
+      return ::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) &&
+             ::access(path.c_str(), X_OK) == 0;
+    };
+    if (name.find('/') != std::string::npos) {
+      return usable(name) ? std::optional<std::string>(name) : std::nullopt;
+    }
+    const char *env = ::getenv("PATH");
+    std::string dirs = (env != nullptr && *env != '\0') ? env : "/bin:/usr/bin";
+    size_t start = 0;
+    for (;;) {
+      size_t end = dirs.find(':', start);
+      std::string dir = dirs.substr(start, end - start);
+      std::string path = (dir.empty() ? "." : dir) + "/" + name;
+      if (usable(path)) {
+        return path;
+      }
+      if (end == std::string::npos) {
+        return std::nullopt;
+      }
+      start = end + 1;
+    }
+  }
+
+  static Address resolve(const std::string &target) {
+    Address a = {};
+    if (target.compare(0, 5, "unix:") == 0) {
+      std::string path = target.substr(5);
+      struct sockaddr_un *un = reinterpret_cast<struct sockaddr_un *>(&a.addr);
+      if (path.empty() || path.size() >= sizeof(un->sun_path)) {
+        throw std::invalid_argument("bad unix socket path " + path);
+      }
+      un->sun_family = AF_UNIX;
+      std::memcpy(un->sun_path, path.c_str(), path.size() + 1);
+      a.len = static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) +
+                                     path.size() + 1);
+      return a;
+    }
+    if (target.compare(0, 4, "udp:") == 0) {
+      // udp:host:port, udp:[v6]:port
+      std::string rest = target.substr(4);
+      size_t colon = rest.rfind(':');
+      if (colon == std::string::npos) {
+        throw std::invalid_argument("notify target needs a port: " + target);
+      }
+      std::string host = rest.substr(0, colon);
+      std::string port = rest.substr(colon + 1);
+      if (host.size() > 1 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+      }
+      struct addrinfo hints = {};
+      hints.ai_family = AF_UNSPEC;
+      hints.ai_socktype = SOCK_DGRAM;
+      struct addrinfo *res = nullptr;
+      int rc = ::getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+      if (rc != 0 || res == nullptr) {
+        throw std::invalid_argument("cannot resolve " + target + ": " +
+                                    gai_strerror(rc));
+      }
+      std::memcpy(&a.addr, res->ai_addr, res->ai_addrlen);
+      a.len = res->ai_addrlen;
+      ::freeaddrinfo(res);
+      return a;
+    }
+    throw std::invalid_argument("notify target must be udp:host:port or "
+                                "unix:/path, not " + target);
+  }
+
+  std::string expand(const Event &event) const {
+    std::string out;
+    out.reserve(message_.size() + 32);
+    for (size_t i = 0; i < message_.size();) {
+      if (message_[i] == '{') {
+        size_t end = message_.find('}', i);
+        if (end != std::string::npos) {
+          std::string key = message_.substr(i + 1, end - i - 1);
+          if (key == "watch") {
+            out += event.watch;
+            i = end + 1;
+            continue;
+          }
+          if (key == "pid") {
+            out += std::to_string(event.pid);
+            i = end + 1;
+            continue;
+          }
+          if (key == "state") {
+            out += event.found ? "up" : "down";
+            i = end + 1;
+            continue;
+          }
+        }
+      }
+      out += message_[i++];
+    }
+    return out;
+  }
+
+  std::string sendSignal(const Event &event) const {
+    if (event.pid <= 0) {
+      throw std::runtime_error("signal " + target_ + ": no matched process");
+    }
+    if (::kill(event.pid, signal_) < 0) {
+      throw std::runtime_error("signal " + target_ + " to pid " +
+                               std::to_string(event.pid) + ": " +
+                               strerror(errno));
+    }
+    return "sent " + target_ + " to pid " + std::to_string(event.pid);
+  }
+
+  // stdio on /dev/null, own process group, default signal mask; reaped by
+  // reapRestarted()
+  std::string spawnDetached() const {
+    std::vector<char *> argv;
+    for (const auto &arg : argv_) {
+      argv.push_back(const_cast<char *>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null",
+                                     O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null",
+                                     O_WRONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+    posix_spawnattr_init(&attr);
+    sigset_t none;
+    sigemptyset(&none);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK |
+                                        POSIX_SPAWN_SETPGROUP);
+    pid_t pid;
+    int rc = posix_spawn(&pid, path_.c_str(), &actions, &attr, argv.data(),
+                         environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0) {
+      throw std::runtime_error("restart " + target_ + ": " + strerror(rc));
+    }
+    {
+      std::lock_guard<std::mutex> lock(restartedMutex());
+      restarted().push_back(pid);
+    }
+    return "restarted " + target_ + " as pid " + std::to_string(pid);
+  }
+
+  // one write() on an O_APPEND fd, so concurrent writers do not interleave
+  std::string appendLine(const Event &event) const {
+    std::string line = expand(event) + "\n";
+    int fd = ::open(target_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+                    0644);
+    if (fd < 0) {
+      throw std::runtime_error("append " + target_ + ": " + strerror(errno));
+    }
+    ssize_t n = ::write(fd, line.data(), line.size());
+    int err = errno;
+    ::close(fd);
+    if (n != static_cast<ssize_t>(line.size())) {
+      throw std::runtime_error("append " + target_ + ": " +
+                               (n < 0 ? strerror(err) : "short write"));
+    }
+    return "appended to " + target_;
+  }
+
+  std::string touchFile() const {
+    int fd = ::open(target_.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      throw std::runtime_error("touch " + target_ + ": " + strerror(errno));
+    }
+    int rc = ::futimens(fd, nullptr);
+    int err = errno;
+    ::close(fd);
+    if (rc < 0) {
+      throw std::runtime_error("touch " + target_ + ": " + strerror(err));
+    }
+    return "touched " + target_;
+  }
+
+  std::string sendDatagram(const Event &event) const {
+    std::string message = expand(event);
+    int fd = ::socket(addr_->addr.ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      throw std::runtime_error("notify " + target_ + ": " + strerror(errno));
+    }
+    ssize_t n = ::sendto(fd, message.data(), message.size(), MSG_NOSIGNAL,
+                         reinterpret_cast<const struct sockaddr *>(&addr_->addr),
+                         addr_->len);
+    int err = errno;
+    ::close(fd);
+    if (n < 0) {
+      throw std::runtime_error("notify " + target_ + ": " + strerror(err));
+    }
+    return "notified " + target_;
+  }
+
+  static std::vector<pid_t> &restarted() {
+    static std::vector<pid_t> pids;
+    return pids;
+  }
+
+  static std::mutex &restartedMutex() {
+    static std::mutex mtx;
+    return mtx;
+  }
+
+  Kind kind_;
+  int time_throttle_;
+  long long time_last_executed_ = 0;
+  int signal_ = 0;
+  std::vector<std::string> argv_;
+  std::string path_;    // argv_[0] as found in PATH when the action was built
+  std::string target_;  // signal name, command, file or address
+  std::string message_; // with {watch}, {pid}, {state}
+  std::shared_ptr<const Address> addr_;
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <mutex>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+/**
+ * @class PidWatcher
+ * @brief Waits on pidfds of matched processes so an exit is seen as soon as
+ * it happens, without walking /proc.
+ *
+ * watch()/unwatch() may be called from any thread while another thread is
+ * blocked in wait().
+ */
+class PidWatcher {
+public:
+  PidWatcher() {
+    epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (epoll_fd_ >= 0 && wake_fd_ >= 0) {
+      struct epoll_event ev = {};
+      ev.events = EPOLLIN;
+      ev.data.u64 = wake_key;
+      ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+    }
+  }
+
+  ~PidWatcher() {
+    for (const auto &entry : fds_) {
+      ::close(entry.second);
+    }
+    if (wake_fd_ >= 0) {
+      ::close(wake_fd_);
+    }
+    if (epoll_fd_ >= 0) {
+      ::close(epoll_fd_);
+    }
+  }
+
+  PidWatcher(const PidWatcher &) = delete;
+  PidWatcher &operator=(const PidWatcher &) = delete;
+
+  /**
+   * @brief Starts watching pid.
+   * @return false if pidfds are not supported or the pid is already gone.
+   */
+  bool watch(int pid) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (fds_.count(pid) != 0) {
+      return true;
+    }
+    int fd = static_cast<int>(::syscall(SYS_pidfd_open, pid, 0));
+    if (fd < 0) {
+      return false;
+    }
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.u64 = static_cast<uint64_t>(pid);
+    if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      ::close(fd);
+      return false;
+    }
+    fds_[pid] = fd;
+    return true;
+  }
+
+  void unwatch(int pid) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = fds_.find(pid);
+    if (it != fds_.end()) {
+      ::close(it->second); // closing also drops it from the epoll set
+      fds_.erase(it);
+    }
+  }
+
+  bool isWatching(int pid) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return fds_.count(pid) != 0;
+  }
+
+  size_t count() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return fds_.size();
+  }
+
+  /**
+   * @brief Blocks until at least one watched process exits, wakeup() is
+   * called or timeout_ms passes (-1 waits forever).
+   * @return The pids that exited; they are no longer watched.
+   */
+  std::vector<int> wait(int timeout_ms) {
+    std::vector<int> exited;
+    struct epoll_event events[16];
+    int n = ::epoll_wait(epoll_fd_, events, 16, timeout_ms);
+    for (int i = 0; i < n; i++) {
+      if (events[i].data.u64 == wake_key) {
+        uint64_t value;
+        ssize_t rc = ::read(wake_fd_, &value, sizeof(value));
+        (void)rc;
+        continue;
+      }
+      int pid = static_cast<int>(events[i].data.u64);
+      unwatch(pid);
+      exited.push_back(pid);
+    }
+    return exited;
+  }
+
+  // Readable when a watched process exits, for an event loop; then call
+  // wait(0).
+  int fd() const { return epoll_fd_; }
+
+  /**
+   * @brief Makes a blocked wait() return early.
+   */
+  void wakeup() {
+    uint64_t one = 1;
+    ssize_t rc = ::write(wake_fd_, &one, sizeof(one));
+    (void)rc;
+  }
+
+private:
+  static constexpr uint64_t wake_key = ~uint64_t(0);
+
+  int epoll_fd_ = -1;
+  int wake_fd_ = -1;
+  std::unordered_map<int, int> fds_;
+  std::mutex mtx_;
+};
@@ -0,0 +1,260 @@
+#pragma once
+
+#include "process_info.hpp"
+#include "proc_scanner.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <mutex>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class ProcEventMonitor
+ * @brief Keeps an in-memory process table current from the kernel process
+ * connector (PROC_EVENT_FORK/EXEC/UID/EXIT) instead of rescanning /proc.
+ *
+ * The socket needs CAP_NET_ADMIN.  When start() fails the caller should keep
+ * using the polling ProcessLister.
+ */
+class ProcEventMonitor {
+public:
+  // Called on the event thread after an event has been applied.  proc is
+  // the new table entry, or nullptr when the process went away.
+  using Listener =
+      std::function<void(unsigned what, int pid, const ProcessInfo *proc)>;
+
+  explicit ProcEventMonitor(const std::string &root = "/proc")
+      : scanner_(root) {}
+
+  ~ProcEventMonitor() { stop(); }
+
+  ProcEventMonitor(const ProcEventMonitor &) = delete;
+  ProcEventMonitor &operator=(const ProcEventMonitor &) = delete;
+
+  /**
+   * @brief Opens and subscribes the connector socket, loads the table and
+   * starts the event thread.
+   * @return false if the process connector is unavailable.
+   */
+  bool start() {
+    if (running_) {
+      return true;
+    }
+    if (!openSocket()) {
+      return false;
+    }
+    // Subscribe before the initial scan so nothing falls in between;
+    // events for pids already in the table are applied idempotently.
+    resync();
+    running_ = true;
+    thread_ = std::thread(&ProcEventMonitor::eventLoop, this);
+    return true;
+  }
+
+  void stop() {
+    if (!running_.exchange(false)) {
+      closeSocket();
+      return;
+    }
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    closeSocket();
+  }
+
+  bool isRunning() const { return running_; }
+
+  void setListener(Listener l) {
+    std::lock_guard<std::mutex> lock(table_mtx_);
+    listener_ = std::move(l);
+  }
+
+  /**
+   * @brief Returns a copy of the current process table.
+   */
+  std::vector<ProcessInfo> getProcesses() {
+    std::lock_guard<std::mutex> lock(table_mtx_);
+    std::vector<ProcessInfo> processList;
+    processList.reserve(table_.size());
+    for (const auto &entry : table_) {
+      processList.push_back(entry.second);
+    }
+    return processList;
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lock(table_mtx_);
+    return table_.size();
+  }
+
+  bool contains(int pid) {
+    std::lock_guard<std::mutex> lock(table_mtx_);
+    return table_.count(pid) != 0;
+  }
+
+  uint64_t eventsApplied() const { return events_applied_; }
+  uint64_t resyncs() const { return resyncs_; }
+
+  /**
+   * @brief Applies a single connector event to the table.  Thread events
+   * (pid != tgid) are ignored, the table only holds processes.
+   */
+  void applyEvent(const struct proc_event &ev) {
+    int pid = -1;
+    bool remove = false;
+    switch (ev.what) {
+    case proc_event::PROC_EVENT_FORK:
+      if (ev.event_data.fork.child_pid != ev.event_data.fork.child_tgid) {
+        return;
+      }
+      pid = ev.event_data.fork.child_pid;
+      break;
+    case proc_event::PROC_EVENT_EXEC:
+      pid = ev.event_data.exec.process_tgid;
+      break;
+    case proc_event::PROC_EVENT_UID:
+      if (ev.event_data.id.process_pid != ev.event_data.id.process_tgid) {
+        return;
+      }
+      pid = ev.event_data.id.process_tgid;
+      break;
+    case proc_event::PROC_EVENT_EXIT:
+      if (ev.event_data.exit.process_pid != ev.event_data.exit.process_tgid) {
+        return;
+      }
+      pid = ev.event_data.exit.process_tgid;
+      remove = true;
+      break;
+    default:
+      return;
+    }
+
+    Listener listener;
+    ProcessInfo proc;
+    bool present = false;
+    {
+      std::lock_guard<std::mutex> lock(table_mtx_);
+      if (!remove && scanner_.readProcess(pid, proc)) {
+        table_[pid] = proc;
+        present = true;
+      } else {
+        table_.erase(pid); // exited, or already gone again
+      }
+      listener = listener_;
+    }
+    ++events_applied_;
+    if (listener) {
+      listener(ev.what, pid, present ? &proc : nullptr);
+    }
+  }
+
+  /**
+   * @brief Rebuilds the table from a full scan, used at start and whenever
+   * the socket reports that events were dropped.
+   */
+  void resync() {
+    std::lock_guard<std::mutex> lock(table_mtx_);
+    table_.clear();
+    scanner_.scan([&](ProcessInfo &&proc) {
+      int pid = proc.pid;
+      table_[pid] = std::move(proc);
+    });
+    ++resyncs_;
+  }
+
+private:
+  bool openSocket() {
+    sock_ = ::socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (sock_ < 0) {
+      return false;
+    }
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = CN_IDX_PROC;
+    addr.nl_pid = 0;
+    if (::bind(sock_, reinterpret_cast<struct sockaddr *>(&addr),
+               sizeof(addr)) < 0) {
+      closeSocket();
+      return false;
+    }
+
+    // nlmsghdr | cn_msg | proc_cn_mcast_op
+    constexpr size_t req_len = NLMSG_LENGTH(sizeof(struct cn_msg) +
+                                            sizeof(enum proc_cn_mcast_op));
+    alignas(struct nlmsghdr) char req[NLMSG_SPACE(req_len)];
+    memset(req, 0, sizeof(req));
+    auto *hdr = reinterpret_cast<struct nlmsghdr *>(req);
+    hdr->nlmsg_len = req_len;
+    hdr->nlmsg_type = NLMSG_DONE;
+    hdr->nlmsg_pid = getpid();
+    auto *msg = static_cast<struct cn_msg *>(NLMSG_DATA(hdr));
+    msg->id.idx = CN_IDX_PROC;
+    msg->id.val = CN_VAL_PROC;
+    msg->len = sizeof(enum proc_cn_mcast_op);
+    enum proc_cn_mcast_op op = PROC_CN_MCAST_LISTEN;
+    memcpy(msg->data, &op, sizeof(op));
+    if (::send(sock_, req, req_len, 0) < 0) {
+      closeSocket();
+      return false;
+    }
+    return true;
+  }
+
+  void closeSocket() {
+    if (sock_ >= 0) {
+      ::close(sock_);
+      sock_ = -1;
+    }
+  }
+
+  void eventLoop() {
+    alignas(struct nlmsghdr) char buf[8192];
+    struct pollfd pfd = {sock_, POLLIN, 0};
+    while (running_) {
+      int rc = ::poll(&pfd, 1, 200);
+      if (rc <= 0) {
+        continue;
+      }
+      ssize_t len = ::recv(sock_, buf, sizeof(buf), 0);
+      if (len < 0) {
+        if (errno == ENOBUFS) {
+          resync(); // the kernel dropped events, start over
+        }
+        continue;
+      }
+      for (auto *hdr = reinterpret_cast<struct nlmsghdr *>(buf);
+           NLMSG_OK(hdr, static_cast<unsigned>(len));
+           hdr = NLMSG_NEXT(hdr, len)) {
+        if (hdr->nlmsg_type == NLMSG_NOOP || hdr->nlmsg_type == NLMSG_ERROR) {
+          continue;
+        }
+        auto *msg = static_cast<struct cn_msg *>(NLMSG_DATA(hdr));
+        if (msg->id.idx != CN_IDX_PROC || msg->id.val != CN_VAL_PROC) {
+          continue;
+        }
+        applyEvent(*reinterpret_cast<struct proc_event *>(msg->data));
+      }
+    }
+  }
+
+  ProcScanner scanner_;
+  std::unordered_map<int, ProcessInfo> table_;
+  std::mutex table_mtx_;
+  Listener listener_;
+  std::thread thread_;
+  std::atomic_bool running_{false};
+  std::atomic<uint64_t> events_applied_{0};
+  std::atomic<uint64_t> resyncs_{0};
+  int sock_ = -1;
+};
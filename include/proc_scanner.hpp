@@ -0,0 +1,308 @@
+#pragma once
+
+#include "process_info.hpp"
+#include "uid_cache.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <string>
+#include <string_view>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+// Per stage counters for ProcScanner::scanStaged.  Each stage only runs for
+// processes that passed the one before it.
+struct ScanStats {
+  uint64_t pids = 0;        // pids listed
+  uint64_t name_checks = 0; // cmdline read, first token compared
+  uint64_t uid_checks = 0;  // status read and user compared
+  uint64_t args_loaded = 0; // ProcessInfo built with all arguments
+
+  // status files that a full scan would have read
+  uint64_t statusReadsAvoided() const { return name_checks - uid_checks; }
+  // argument vectors that a full scan would have built
+  uint64_t argsAvoided() const { return name_checks - args_loaded; }
+
+  ScanStats &operator+=(const ScanStats &o) {
+    pids += o.pids;
+    name_checks += o.name_checks;
+    uid_checks += o.uid_checks;
+    args_loaded += o.args_loaded;
+    return *this;
+  }
+};
+
+/**
+ * @class ProcScanner
+ * @brief Walks /proc with getdents64 on a single directory fd and reads the
+ * per-pid files with openat/read into buffers owned by the scanner.
+ *
+ * The buffers only ever grow, so after the first scan the only heap
+ * allocations are the strings that end up in the returned ProcessInfo.
+ */
+class ProcScanner {
+public:
+  explicit ProcScanner(const std::string &root = "/proc") : root_(root) {
+    dent_buf_.resize(32768);
+    cmdline_buf_.resize(4096);
+    status_buf_.resize(4096);
+  }
+
+  ~ProcScanner() { closeRoot(); }
+
+  ProcScanner(const ProcScanner &) = delete;
+  ProcScanner &operator=(const ProcScanner &) = delete;
+
+  /**
+   * @brief Calls fn(pid) for every numeric directory under the root.
+   */
+  template <typename Fn> void forEachPid(Fn &&fn) {
+    if (!openRoot()) {
+      return;
+    }
+    ::lseek(dir_fd_, 0, SEEK_SET);
+    for (;;) {
+      long n = ::syscall(SYS_getdents64, dir_fd_, dent_buf_.data(),
+                         dent_buf_.size());
+      if (n <= 0) {
+        break;
+      }
+      for (long off = 0; off < n;) {
+        auto *d = reinterpret_cast<linux_dirent64 *>(dent_buf_.data() + off);
+        off += d->d_reclen;
+        if (d->d_type != DT_DIR && d->d_type != DT_UNKNOWN) {
+          continue;
+        }
+        int pid = parsePid(d->d_name);
+        if (pid > 0) {
+          fn(pid);
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief Fills proc for a single pid.
+   * @return false if the process went away while it was being read.
+   */
+  bool readProcess(int pid, ProcessInfo &proc) {
+    ssize_t status_len = readPidFile(pid, "status", status_buf_);
+    if (status_len < 0) {
+      return false;
+    }
+    ssize_t cmd_len = readPidFile(pid, "cmdline", cmdline_buf_);
+    if (cmd_len < 0) {
+      return false;
+    }
+
+    proc.pid = pid;
+    fillFromCmdline(proc, static_cast<size_t>(cmd_len));
+    proc.uid = parseUid(status_buf_.data(), status_len);
+    proc.user = (proc.uid >= 0) ? uidCache().name(proc.uid) : "";
+    return true;
+  }
+
+  /**
+   * @brief Calls fn(ProcessInfo &&) for the processes that pass the filter.
+   * The name is checked from cmdline first (filter.nameStage), status is
+   * only read for name matches (filter.userStage) and the argument list is
+   * only built for processes that also match the user.
+   */
+  template <typename Filter, typename Fn>
+  void scanStaged(const Filter &filter, ScanStats &stats, Fn &&fn) {
+    forEachPid([&](int pid) {
+      ++stats.pids;
+      ssize_t cmd_len = readPidFile(pid, "cmdline", cmdline_buf_);
+      if (cmd_len < 0) {
+        return;
+      }
+      ++stats.name_checks;
+      const char *cmd = cmdline_buf_.data();
+      const char *nul =
+          static_cast<const char *>(memchr(cmd, '\0', cmd_len));
+      std::string_view name(cmd, nul ? static_cast<size_t>(nul - cmd)
+                                     : static_cast<size_t>(cmd_len));
+      if (!filter.nameStage(name)) {
+        return;
+      }
+
+      ssize_t status_len = readPidFile(pid, "status", status_buf_);
+      if (status_len < 0) {
+        return;
+      }
+      ++stats.uid_checks;
+      long uid = parseUid(status_buf_.data(), status_len);
+      std::string user = (uid >= 0) ? uidCache().name(uid) : "";
+      if (!filter.userStage(name, uid, user)) {
+        return;
+      }
+
+      ++stats.args_loaded;
+      ProcessInfo proc;
+      proc.pid = pid;
+      proc.uid = uid;
+      proc.user = std::move(user);
+      fillFromCmdline(proc, static_cast<size_t>(cmd_len));
+      fn(std::move(proc));
+    });
+  }
+
+  /**
+   * @brief Calls fn(ProcessInfo &&) for every process that could be read.
+   */
+  template <typename Fn> void scan(Fn &&fn) {
+    forEachPid([&](int pid) {
+      ProcessInfo proc;
+      if (readProcess(pid, proc)) {
+        fn(std::move(proc));
+      }
+    });
+  }
+
+  std::vector<ProcessInfo> scan() {
+    std::vector<ProcessInfo> processList;
+    scan([&](ProcessInfo &&proc) { processList.push_back(std::move(proc)); });
+    return processList;
+  }
+
+  const std::string &root() const { return root_; }
+
+  // Points the scanner at another procfs-like tree, e.g. one written by
+  // fake_proc_gen for benchmarks.
+  void setRoot(const std::string &root) {
+    closeRoot();
+    root_ = root;
+  }
+
+  /**
+   * @brief Reads <root>/<pid>/<file> into buf, growing it as needed.
+   * @return Number of bytes read, or -1 if the file could not be opened or
+   * read (e.g. ESRCH once the process has exited); a partial read is not
+   * returned, so callers never parse a truncated stat or cmdline.
+   */
+  ssize_t readPidFile(int pid, const char *file, std::vector<char> &buf) {
+    if (!openRoot()) {
+      return -1;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "%d/%s", pid, file);
+    int fd = ::openat(dir_fd_, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return -1;
+    }
+    size_t len = 0;
+    for (;;) {
+      if (len == buf.size()) {
+        buf.resize(buf.size() * 2);
+      }
+      ssize_t n = ::read(fd, buf.data() + len, buf.size() - len);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        ::close(fd);
+        return -1;
+      }
+      if (n == 0) {
+        break;
+      }
+      len += n;
+    }
+    ::close(fd);
+    return static_cast<ssize_t>(len);
+  }
+
+  /**
+   * @brief Returns the real uid from the "Uid:" line of a status file, or -1.
+   */
+  static long parseUid(const char *buf, size_t len) {
+    static const char key[] = "Uid:";
+    const char *end = buf + len;
+    for (const char *line = buf; line < end;) {
+      const char *nl = static_cast<const char *>(memchr(line, '\n', end - line));
+      const char *line_end = nl ? nl : end;
+      if (static_cast<size_t>(line_end - line) > sizeof(key) - 1 &&
+          memcmp(line, key, sizeof(key) - 1) == 0) {
+        const char *q = line + sizeof(key) - 1;
+        while (q < line_end && (*q == ' ' || *q == '\t')) {
+          ++q;
+        }
+        long uid = 0;
+        bool digits = false;
+        while (q < line_end && *q >= '0' && *q <= '9') {
+          uid = uid * 10 + (*q++ - '0');
+          digits = true;
+        }
+        return digits ? uid : -1;
+      }
+      line = nl ? nl + 1 : end;
+    }
+    return -1;
+  }
+
+private:
+  // name is the first NUL terminated token, arguments are all of them
+  void fillFromCmdline(ProcessInfo &proc, size_t len) {
+    proc.name.clear();
+    proc.arguments.clear();
+    const char *p = cmdline_buf_.data();
+    const char *end = p + len;
+    while (p < end) {
+      const char *nul = static_cast<const char *>(memchr(p, '\0', end - p));
+      const char *tok_end = nul ? nul : end;
+      proc.arguments.emplace_back(p, tok_end);
+      p = nul ? nul + 1 : end;
+    }
+    if (!proc.arguments.empty()) {
+      proc.name = proc.arguments.front();
+    }
+  }
+
+  struct linux_dirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+  };
+
+  bool openRoot() {
+    if (dir_fd_ < 0) {
+      dir_fd_ = ::open(root_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+    return dir_fd_ >= 0;
+  }
+
+  void closeRoot() {
+    if (dir_fd_ >= 0) {
+      ::close(dir_fd_);
+      dir_fd_ = -1;
+    }
+  }
+
+  static int parsePid(const char *name) {
+    if (*name == '\0') {
+      return -1;
+    }
+    int pid = 0;
+    for (const char *c = name; *c; ++c) {
+      if (*c < '0' || *c > '9') {
+        return -1;
+      }
+      pid = pid * 10 + (*c - '0');
+    }
+    return pid;
+  }
+
+  std::string root_;
+  int dir_fd_ = -1;
+  std::vector<char> dent_buf_;
+  std::vector<char> cmdline_buf_;
+  std::vector<char> status_buf_;
+};
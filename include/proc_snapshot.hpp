@@ -0,0 +1,213 @@
+#pragma once
+
+#include "process_info.hpp"
+#include "proc_scanner.hpp"
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Processes that appeared or went away between two ProcSnapshot refreshes.
+// A pid whose generation changed (pid reuse, or an exec that changed comm)
+// shows up in both lists.
+struct ProcDelta {
+  std::vector<int> added;
+  std::vector<int> removed;
+  size_t parsed = 0; // processes whose status/cmdline were read
+};
+
+/**
+ * @class ProcSnapshot
+ * @brief Persistent process table refreshed incrementally.
+ *
+ * Each refresh lists the pids and reads only /proc/<pid>/stat.  A process is
+ * identified by (pid, starttime); its comm is kept as well so an exec is
+ * noticed.  status and cmdline are only parsed for processes whose identity
+ * is new, so a box with a stable process set does work proportional to the
+ * churn rather than the table size.
+ */
+class ProcSnapshot {
+public:
+  explicit ProcSnapshot(const std::string &root = "/proc") : scanner_(root) {
+    stat_buf_.resize(1024);
+  }
+
+  // Switches to another procfs root; the table starts over.
+  void setRoot(const std::string &root) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    scanner_.setRoot(root);
+    table_.clear();
+  }
+
+  /**
+   * @brief Brings the table up to date.
+   * @return What changed since the previous refresh.
+   */
+  ProcDelta refresh() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    ProcDelta delta;
+    ++generation_;
+    scanner_.forEachPid([&](int pid) {
+      uint64_t starttime;
+      char comm[32];
+      if (!readStat(pid, starttime, comm, sizeof(comm))) {
+        return;
+      }
+      auto it = table_.find(pid);
+      if (it != table_.end()) {
+        Entry &entry = it->second;
+        if (entry.starttime == starttime && strcmp(entry.comm, comm) == 0) {
+          entry.generation = generation_;
+          return;
+        }
+        delta.removed.push_back(pid);
+        table_.erase(it);
+      }
+      Entry entry;
+      if (!scanner_.readProcess(pid, entry.info)) {
+        return;
+      }
+      ++delta.parsed;
+      entry.starttime = starttime;
+      strcpy(entry.comm, comm);
+      entry.generation = generation_;
+      table_.emplace(pid, std::move(entry));
+      delta.added.push_back(pid);
+    });
+
+    for (auto it = table_.begin(); it != table_.end();) {
+      if (it->second.generation != generation_) {
+        delta.removed.push_back(it->first);
+        it = table_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    return delta;
+  }
+
+  /**
+   * @brief Looks up a pid.  The pointer is valid until the next refresh().
+   */
+  const ProcessInfo *find(int pid) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = table_.find(pid);
+    return (it != table_.end()) ? &it->second.info : nullptr;
+  }
+
+  /**
+   * @brief Pointers into the table for the given pids, skipping any that are
+   * not present.  Valid until the next refresh().
+   */
+  std::vector<const ProcessInfo *> select(const std::vector<int> &pids) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    std::vector<const ProcessInfo *> out;
+    out.reserve(pids.size());
+    for (int pid : pids) {
+      auto it = table_.find(pid);
+      if (it != table_.end()) {
+        out.push_back(&it->second.info);
+      }
+    }
+    return out;
+  }
+
+  std::vector<const ProcessInfo *> all() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    std::vector<const ProcessInfo *> out;
+    out.reserve(table_.size());
+    for (const auto &entry : table_) {
+      out.push_back(&entry.second.info);
+    }
+    return out;
+  }
+
+  /**
+   * @brief Copy of the table as of the last refresh().
+   */
+  std::vector<ProcessInfo> getProcesses() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    std::vector<ProcessInfo> processList;
+    processList.reserve(table_.size());
+    for (const auto &entry : table_) {
+      processList.push_back(entry.second.info);
+    }
+    return processList;
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return table_.size();
+  }
+
+  /**
+   * @brief Pulls starttime (field 22) and comm (field 2) out of a stat line.
+   * comm may itself contain spaces and parentheses, so fields are counted
+   * from the last ')'.
+   */
+  static bool parseStat(const char *buf, size_t len, uint64_t &starttime,
+                        char *comm, size_t comm_size) {
+    const char *end = buf + len;
+    const char *open = static_cast<const char *>(memchr(buf, '(', len));
+    const char *close = nullptr;
+    for (const char *p = end; p > buf; --p) {
+      if (p[-1] == ')') {
+        close = p - 1;
+        break;
+      }
+    }
+    if (open == nullptr || close == nullptr || close < open) {
+      return false;
+    }
+    size_t comm_len = static_cast<size_t>(close - open - 1);
+    if (comm_len >= comm_size) {
+      comm_len = comm_size - 1;
+    }
+    memcpy(comm, open + 1, comm_len);
+    comm[comm_len] = '\0';
+
+    // after ") " comes field 3 (state); starttime is field 22
+    const char *p = close + 1;
+    for (int field = 2; field < 22 && p < end; ++p) {
+      if (*p == ' ') {
+        ++field;
+      }
+    }
+    while (p < end && *p == ' ') {
+      ++p;
+    }
+    if (p >= end || *p < '0' || *p > '9') {
+      return false;
+    }
+    starttime = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+      starttime = starttime * 10 + static_cast<uint64_t>(*p++ - '0');
+    }
+    return true;
+  }
+
+private:
+  struct Entry {
+    uint64_t starttime = 0;
+    char comm[32] = {};
+    uint64_t generation = 0;
+    ProcessInfo info;
+  };
+
+  bool readStat(int pid, uint64_t &starttime, char *comm, size_t comm_size) {
+    ssize_t len = scanner_.readPidFile(pid, "stat", stat_buf_);
+    if (len <= 0) {
+      return false;
+    }
+    return parseStat(stat_buf_.data(), static_cast<size_t>(len), starttime,
+                     comm, comm_size);
+  }
+
+  ProcScanner scanner_;
+  std::unordered_map<int, Entry> table_;
+  std::vector<char> stat_buf_;
+  uint64_t generation_ = 0;
+  std::mutex mtx_;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct ProcessInfo {
+  std::string name;
+  int pid;
+  std::string user; // Add a field for the username
+  std::vector<std::string> arguments;
+  long uid = -1;    // -1 if it could not be read
+};
+
+struct matchProcess {
+  std::string process_name;
+  std::string username;
+  std::string argument;
+  long uid = -1;    // username resolved at config load, -1 if unresolved
+};
+
+// User test for a watch: an integer compare when the watch's username was
+// resolved to a uid, the old string compare otherwise.
+inline bool userMatches(const ProcessInfo &process,
+                        const matchProcess &searchCriteria) {
+  if (searchCriteria.uid >= 0 && process.uid >= 0) {
+    return process.uid == searchCriteria.uid;
+  }
+  return process.user == searchCriteria.username;
+}
+
+// scanStaged filter for a single watch.
+struct MatchFilter {
+  const matchProcess &criteria;
+
+  bool nameStage(std::string_view name) const {
+    return name == criteria.process_name;
+  }
+  bool userStage(std::string_view, long uid, const std::string &user) const {
+    if (criteria.uid >= 0) {
+      return uid == criteria.uid;
+    }
+    return user == criteria.username;
+  }
+};
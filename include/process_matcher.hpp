@@ -0,0 +1,302 @@
+#pragma once
+
+#include "process_info.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @class AhoCorasick
+ * @brief Multi-pattern substring automaton.  One pass over a text reports
+ * every pattern that occurs in it.
+ */
+class AhoCorasick {
+public:
+  AhoCorasick() { nodes_.emplace_back(); }
+
+  // Returns the pattern id; adding the same pattern twice returns the same id.
+  size_t add(const std::string &pattern) {
+    size_t state = 0;
+    for (unsigned char c : pattern) {
+      int next = child(state, c);
+      if (next < 0) {
+        next = static_cast<int>(nodes_.size());
+        nodes_[state].next.emplace_back(c, next);
+        nodes_.emplace_back();
+      }
+      state = static_cast<size_t>(next);
+    }
+    if (nodes_[state].pattern < 0) {
+      nodes_[state].pattern = static_cast<int>(patterns_++);
+    }
+    built_ = false;
+    return static_cast<size_t>(nodes_[state].pattern);
+  }
+
+  size_t patterns() const { return patterns_; }
+
+  // Computes the failure and output links, call after the last add().
+  void build() {
+    std::deque<size_t> queue;
+    for (auto &edge : nodes_[0].next) {
+      nodes_[edge.second].fail = 0;
+      queue.push_back(edge.second);
+    }
+    while (!queue.empty()) {
+      size_t state = queue.front();
+      queue.pop_front();
+      Node &node = nodes_[state];
+      std::sort(node.next.begin(), node.next.end());
+      size_t fail = node.fail;
+      node.output = (nodes_[fail].pattern >= 0) ? static_cast<int>(fail)
+                                                : nodes_[fail].output;
+      for (auto &edge : node.next) {
+        size_t f = fail;
+        int target = child(f, edge.first);
+        while (target < 0 && f != 0) {
+          f = nodes_[f].fail;
+          target = child(f, edge.first);
+        }
+        nodes_[edge.second].fail =
+            (target >= 0 && target != edge.second)
+                ? static_cast<size_t>(target)
+                : 0;
+        queue.push_back(edge.second);
+      }
+    }
+    std::sort(nodes_[0].next.begin(), nodes_[0].next.end());
+    built_ = true;
+  }
+
+  // Calls hit(pattern_id) for every pattern occurrence in text.
+  template <typename Fn> void scan(std::string_view text, Fn &&hit) const {
+    size_t state = 0;
+    for (unsigned char c : text) {
+      int next = child(state, c);
+      while (next < 0 && state != 0) {
+        state = nodes_[state].fail;
+        next = child(state, c);
+      }
+      state = (next >= 0) ? static_cast<size_t>(next) : 0;
+      for (int s = (nodes_[state].pattern >= 0) ? static_cast<int>(state)
+                                                : nodes_[state].output;
+           s > 0; s = nodes_[s].output) {
+        hit(static_cast<size_t>(nodes_[s].pattern));
+      }
+    }
+  }
+
+private:
+  struct Node {
+    std::vector<std::pair<unsigned char, int>> next;
+    size_t fail = 0;
+    int pattern = -1; // pattern ending here
+    int output = -1;  // nearest suffix state that ends a pattern
+  };
+
+  // Edges are sorted once build() ran, before that they are searched
+  // linearly.
+  int child(size_t state, unsigned char c) const {
+    const auto &next = nodes_[state].next;
+    if (built_) {
+      auto it = std::lower_bound(
+          next.begin(), next.end(), c,
+          [](const auto &edge, unsigned char key) { return edge.first < key; });
+      return (it != next.end() && it->first == c) ? it->second : -1;
+    }
+    for (const auto &edge : next) {
+      if (edge.first == c) {
+        return edge.second;
+      }
+    }
+    return -1;
+  }
+
+  std::vector<Node> nodes_;
+  size_t patterns_ = 0;
+  bool built_ = false;
+};
+
+/**
+ * @class CompiledMatcher
+ * @brief All watches compiled into one matcher at config load.
+ *
+ * Watches are hash-indexed by exact process name and then by uid (or by user
+ * name when the uid could not be resolved; a process whose uid could not be
+ * read is matched by user name too, as userMatches does), and all argument
+ * substrings go
+ * into one Aho-Corasick automaton.  match() makes one pass over a process
+ * table and returns, for every watch, the first process that matches it -
+ * the same process searchProcess would have returned.
+ *
+ * Not thread safe: match() uses scratch space inside the matcher.
+ */
+class CompiledMatcher {
+public:
+  CompiledMatcher() = default;
+
+  explicit CompiledMatcher(const std::vector<matchProcess> &watches) {
+    for (const auto &m : watches) {
+      add(m);
+    }
+    compile();
+  }
+
+  // Adds a watch, returns its index in match() results.
+  size_t add(const matchProcess &m) {
+    size_t id = watch_pattern_.size();
+    watch_pattern_.push_back(m.argument.empty() ? empty_pattern
+                                                : ac_.add(m.argument));
+    NameEntry &entry = by_name_[m.process_name];
+    if (m.uid >= 0) {
+      entry.by_uid[m.uid].push_back(id);
+      entry.by_uid_name[m.username].push_back(id);
+    } else {
+      entry.by_user[m.username].push_back(id);
+    }
+    return id;
+  }
+
+  void compile() {
+    ac_.build();
+    seen_.assign(ac_.patterns(), 0);
+    stamp_ = 0;
+  }
+
+  size_t size() const { return watch_pattern_.size(); }
+
+  // scanStaged filter stages: could any watch match this name / user?
+  bool nameStage(std::string_view name) const {
+    return by_name_.find(name) != by_name_.end();
+  }
+
+  bool userStage(std::string_view name, long uid,
+                 const std::string &user) const {
+    auto it = by_name_.find(name);
+    if (it == by_name_.end()) {
+      return false;
+    }
+    return (uid >= 0 ? it->second.by_uid.count(uid) != 0
+                     : it->second.by_uid_name.count(user) != 0) ||
+           it->second.by_user.count(user) != 0;
+  }
+
+  /**
+   * @brief One pass over processes.
+   * @return For each watch, the first matching process or nullptr.
+   */
+  std::vector<const ProcessInfo *>
+  match(const std::vector<ProcessInfo> &processes) {
+    std::vector<const ProcessInfo *> found(size(), nullptr);
+    size_t remaining = size();
+    for (const auto &process : processes) {
+      if (remaining == 0) {
+        break;
+      }
+      matchOne(process, found, remaining);
+    }
+    return found;
+  }
+
+  std::vector<const ProcessInfo *>
+  match(const std::vector<const ProcessInfo *> &processes) {
+    std::vector<const ProcessInfo *> found(size(), nullptr);
+    size_t remaining = size();
+    for (const ProcessInfo *process : processes) {
+      if (remaining == 0) {
+        break;
+      }
+      matchOne(*process, found, remaining);
+    }
+    return found;
+  }
+
+private:
+  static constexpr size_t empty_pattern = ~size_t(0);
+
+  struct NameHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view s) const {
+      return std::hash<std::string_view>{}(s);
+    }
+  };
+
+  struct NameEntry {
+    std::unordered_map<long, std::vector<size_t>> by_uid;
+    // the by_uid watches again, by user name, for processes without a uid
+    std::unordered_map<std::string, std::vector<size_t>, NameHash,
+                       std::equal_to<>>
+        by_uid_name;
+    std::unordered_map<std::string, std::vector<size_t>, NameHash,
+                       std::equal_to<>>
+        by_user;
+  };
+
+  void matchOne(const ProcessInfo &process,
+                std::vector<const ProcessInfo *> &found, size_t &remaining) {
+    auto it = by_name_.find(process.name);
+    if (it == by_name_.end()) {
+      return;
+    }
+    const std::vector<size_t> *by_uid = nullptr;
+    const std::vector<size_t> *by_user = nullptr;
+    if (process.uid >= 0) {
+      auto u = it->second.by_uid.find(process.uid);
+      if (u != it->second.by_uid.end()) {
+        by_uid = &u->second;
+      }
+    } else {
+      auto u = it->second.by_uid_name.find(process.user);
+      if (u != it->second.by_uid_name.end()) {
+        by_uid = &u->second;
+      }
+    }
+    auto n = it->second.by_user.find(process.user);
+    if (n != it->second.by_user.end()) {
+      by_user = &n->second;
+    }
+    if (by_uid == nullptr && by_user == nullptr) {
+      return;
+    }
+
+    // one automaton pass over the arguments marks every pattern present
+    if (++stamp_ == 0) {
+      std::fill(seen_.begin(), seen_.end(), 0);
+      stamp_ = 1;
+    }
+    for (const auto &arg : process.arguments) {
+      ac_.scan(arg, [&](size_t pattern) { seen_[pattern] = stamp_; });
+    }
+
+    for (const std::vector<size_t> *ids : {by_uid, by_user}) {
+      if (ids == nullptr) {
+        continue;
+      }
+      for (size_t id : *ids) {
+        if (found[id] != nullptr) {
+          continue;
+        }
+        size_t pattern = watch_pattern_[id];
+        bool hit = (pattern == empty_pattern) ? !process.arguments.empty()
+                                              : seen_[pattern] == stamp_;
+        if (hit) {
+          found[id] = &process;
+          --remaining;
+        }
+      }
+    }
+  }
+
+  AhoCorasick ac_;
+  std::vector<size_t> watch_pattern_;
+  std::unordered_map<std::string, NameEntry, NameHash, std::equal_to<>>
+      by_name_;
+  std::vector<uint32_t> seen_;
+  uint32_t stamp_ = 0;
+};
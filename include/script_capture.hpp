@@ -0,0 +1,267 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <fcntl.h>
+#include <functional>
+#include <string>
+#include <sys/types.h>
+#include <unistd.h>
+#include <vector>
+#ifndef __FreeBSD__
+#include "event_loop.hpp"
+#include <sys/syscall.h>
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#else
+#include <poll.h>
+#endif
+
+/**
+ * @class ScriptCapture
+ * @brief Drains a script's stdout and stderr without blocking, hands every
+ * line to a sink as it arrives and enforces a byte cap and a wall-clock
+ * timeout for the run.
+ *
+ * The pipes (and an fd that becomes readable when the script exits: a
+ * pidfd, or the zygote's reply socket) are watched by an EventLoop and
+ * read in 64 KiB chunks.  Bytes past max_bytes are read and discarded so
+ * the script never blocks on a full pipe; the run is marked truncated.  At
+ * the timeout the script's process group gets SIGKILL.  Once the script
+ * has exited the pipes get a short grace period to reach EOF, so a
+ * background child holding them open does not hold up the run.
+ *
+ * The EventLoop is the run's own, not the daemon's: run() blocks the
+ * calling thread until the script is done or the timeout has passed.  It
+ * must therefore run on an ActionPool worker, never on the daemon's loop
+ * thread, which is why action_workers = 0 is not honoured for scripts.
+ */
+class ScriptCapture {
+public:
+  using LineSink = std::function<void(const std::string &line, bool is_stderr)>;
+
+  struct Limits {
+    size_t max_bytes = 64 * 1024;             // stdout and stderr together
+    std::chrono::milliseconds timeout{60000}; // 0 waits forever
+  };
+
+  struct Outcome {
+    std::string output;  // stdout, up to max_bytes
+    size_t bytes = 0;    // everything read, kept or not
+    bool truncated = false;
+    bool timed_out = false;
+  };
+
+  ScriptCapture(const Limits &limits, const LineSink &sink)
+      : limits_(limits), sink_(sink) {}
+
+  /**
+   * @brief Captures until both pipes reach EOF and the script has exited.
+   * Closes out_fd and err_fd; exit_fd stays open (-1 if there is none).
+   */
+  Outcome run(pid_t pgid, int out_fd, int err_fd, int exit_fd) {
+    Stream streams[2] = {{out_fd, false, {}, out_fd >= 0},
+                         {err_fd, true, {}, err_fd >= 0}};
+    for (auto &s : streams) {
+      if (s.open) {
+        ::fcntl(s.fd, F_SETFL, ::fcntl(s.fd, F_GETFL) | O_NONBLOCK);
+      }
+    }
+    buf_.resize(kChunk);
+    exited_ = (exit_fd < 0);
+    wait(pgid, streams, exit_fd);
+    for (auto &s : streams) {
+      flushPartial(s);
+      if (s.fd >= 0) {
+        ::close(s.fd);
+      }
+    }
+    return std::move(outcome_);
+  }
+
+  // fd that is readable once pid has exited, -1 if the kernel has none
+  static int exitFd(pid_t pid) {
+#ifndef __FreeBSD__
+    return static_cast<int>(::syscall(SYS_pidfd_open, pid, 0));
+#else
+    (void)pid;
+    return -1;
+#endif
+  }
+
+private:
+  static constexpr size_t kChunk = 64 * 1024;
+  static constexpr std::chrono::milliseconds kGrace{1000};
+
+  struct Stream {
+    int fd;
+    bool is_stderr;
+    std::string partial; // line without its newline yet
+    bool open;
+  };
+
+  bool finished(const Stream *streams) const {
+    return exited_ && !streams[0].open && !streams[1].open;
+  }
+
+#ifndef __FreeBSD__
+  void wait(pid_t pgid, Stream *streams, int exit_fd) {
+    EventLoop loop;
+    if (!loop.isValid()) {
+      waitBlocking(streams);
+      return;
+    }
+    auto check = [&] {
+      if (finished(streams)) {
+        loop.stop();
+      }
+    };
+    for (int i = 0; i < 2; i++) {
+      Stream &s = streams[i];
+      if (s.open) {
+        loop.addFd(s.fd, EPOLLIN, [&, i](uint32_t) {
+          if (!drain(streams[i])) {
+            loop.removeFd(streams[i].fd);
+            check();
+          }
+        });
+      }
+    }
+    if (exit_fd >= 0) {
+      loop.addFd(exit_fd, EPOLLIN, [&](uint32_t) {
+        loop.removeFd(exit_fd);
+        exited_ = true;
+        check();
+        // pipes still open: a background child has them
+        loop.addTimer(kGrace, [&] { loop.stop(); }, false);
+      });
+    }
+    if (limits_.timeout.count() > 0) {
+      loop.addTimer(limits_.timeout, [&] {
+        outcome_.timed_out = true;
+        ::kill(-pgid, SIGKILL);
+        loop.addTimer(kGrace, [&] { loop.stop(); }, false);
+      }, false);
+    }
+    if (!finished(streams)) {
+      loop.run();
+    }
+  }
+#else
+  void wait(pid_t pgid, Stream *streams, int exit_fd) {
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point give_up =
+        std::chrono::steady_clock::time_point::max();
+    while (!finished(streams)) {
+      auto now = std::chrono::steady_clock::now();
+      if (now >= give_up) {
+        return;
+      }
+      if (!outcome_.timed_out && limits_.timeout.count() > 0 &&
+          now >= start + limits_.timeout) {
+        outcome_.timed_out = true;
+        ::kill(-pgid, SIGKILL);
+        give_up = std::min(give_up, now + kGrace);
+      }
+      struct pollfd fds[3];
+      int n = 0;
+      for (int i = 0; i < 2; i++) {
+        if (streams[i].open) {
+          fds[n++] = {streams[i].fd, POLLIN, 0};
+        }
+      }
+      if (!exited_) {
+        fds[n++] = {exit_fd, POLLIN, 0};
+      }
+      if (::poll(fds, n, 100) < 0 && errno != EINTR) {
+        return;
+      }
+      for (int i = 0; i < n; i++) {
+        if (fds[i].revents == 0) {
+          continue;
+        }
+        if (fds[i].fd == exit_fd) {
+          exited_ = true;
+          give_up = std::min(give_up, std::chrono::steady_clock::now() + kGrace);
+        } else {
+          drain(fds[i].fd == streams[0].fd ? streams[0] : streams[1]);
+        }
+      }
+    }
+  }
+#endif
+
+  // without a poller: read to EOF as the executor always did
+  void waitBlocking(Stream *streams) {
+    for (int i = 0; i < 2; i++) {
+      ::fcntl(streams[i].fd, F_SETFL,
+              ::fcntl(streams[i].fd, F_GETFL) & ~O_NONBLOCK);
+      while (streams[i].open) {
+        drain(streams[i]);
+      }
+    }
+  }
+
+  // Reads what is there; false at EOF or on error.
+  bool drain(Stream &s) {
+    for (;;) {
+      ssize_t n = ::read(s.fd, buf_.data(), buf_.size());
+      if (n > 0) {
+        take(s, buf_.data(), static_cast<size_t>(n));
+        continue;
+      }
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return true;
+      }
+      s.open = false;
+      return false;
+    }
+  }
+
+  void take(Stream &s, const char *data, size_t len) {
+    size_t kept = std::min(outcome_.bytes, limits_.max_bytes);
+    size_t keep = std::min(len, limits_.max_bytes - kept);
+    outcome_.bytes += len;
+    if (keep < len) {
+      outcome_.truncated = true;
+    }
+    if (!s.is_stderr) {
+      outcome_.output.append(data, keep);
+    }
+    const char *end = data + keep;
+    while (data < end) {
+      const char *nl = std::find(data, end, '\n');
+      s.partial.append(data, nl);
+      if (nl == end) {
+        break;
+      }
+      emit(s);
+      data = nl + 1;
+    }
+  }
+
+  void flushPartial(Stream &s) {
+    if (!s.partial.empty()) {
+      emit(s);
+    }
+  }
+
+  void emit(Stream &s) {
+    if (sink_) {
+      sink_(s.partial, s.is_stderr);
+    }
+    s.partial.clear();
+  }
+
+  const Limits &limits_;
+  const LineSink &sink_;
+  std::vector<char> buf_;
+  Outcome outcome_;
+  bool exited_ = false;
+};
@@ -1,6 +1,13 @@
-#include <array>
+#include <atomic>
 #include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <spawn.h>
 #include <stdexcept>
 #include <string>
 #include <sys/stat.h>
@@ -8,6 +15,47 @@
 #include <sys/wait.h>
 #include <unistd.h>
 #include <vector>
+#include "script_capture.hpp"
+#include "zygote.hpp"
+
+extern char **environ;
+
+/**
+ * @brief How one run of a script went.
+ */
+struct ScriptRun {
+  bool executed = false;  // false when the throttle held it back
+  int status = 0;         // as from waitpid()
+  bool timed_out = false; // killed at the timeout
+  bool truncated = false; // output past the byte cap was dropped
+  size_t bytes = 0;       // stdout and stderr bytes the script wrote
+  std::string output;     // stdout, up to the byte cap
+
+  // a script killed by a signal (SIGSEGV, the OOM killer) failed too
+  bool ok() const {
+    return !executed || (!timed_out && WIFEXITED(status) &&
+                         WEXITSTATUS(status) == 0);
+  }
+
+  std::string summary() const {
+    if (!executed) {
+      return "Throttle time not reached. Script not executed.";
+    }
+    std::string s;
+    if (timed_out) {
+      s = "timed out, process group killed";
+    } else if (WIFSIGNALED(status)) {
+      s = "killed by signal " + std::to_string(WTERMSIG(status));
+    } else {
+      s = "exit status " + std::to_string(WEXITSTATUS(status));
+    }
+    s += ", " + std::to_string(bytes) + " bytes of output";
+    if (truncated) {
+      s += ", truncated";
+    }
+    return s;
+  }
+};
 
 /**
  * @class ShellScriptExecutor
@@ -18,50 +66,163 @@ class ShellScriptExecutor {
   bool shell_good = false;  /**< Boolean flag indicating the validity of the shell environment. */
 
 public:
+  /**
+   * @brief How the script process is started.  spawn uses posix_spawn,
+   * which does not copy the daemon's page tables (glibc starts the child
+   * with clone(CLONE_VM|CLONE_VFORK)); fork is the classic fork()+exec;
+   * zygote has the zygote() helper start it, falling back to spawn when the
+   * helper is not running.
+   */
+  enum class Launcher { spawn, fork, zygote };
+
+  static std::optional<Launcher> parseLauncher(const std::string &name) {
+    if (name == "spawn") {
+      return Launcher::spawn;
+    }
+    if (name == "fork") {
+      return Launcher::fork;
+    }
+    if (name == "zygote") {
+      return Launcher::zygote;
+    }
+    return std::nullopt;
+  }
 
  /**
    * @brief Constructor for ShellScriptExecutor.
    * @param scriptPath The path to the shell script to be executed.
    * @param args The arguments to be passed to the shell script.
    * @param time_throttle The time throttle in seconds to control script execution frequency.
+   * @param launcher How to start the script process.
    */
 
   ShellScriptExecutor(const std::string &scriptPath,
-                      const std::vector<std::string> &args, int time_throttle)
+                      const std::vector<std::string> &args, int time_throttle,
+                      Launcher launcher = Launcher::spawn)
       : scriptPath(scriptPath), args(args), time_throttle(time_throttle),
-        time_last_executed(0) {
+        launcher(launcher),
+        exec(std::make_shared<const ExecArgs>(scriptPath, args)) {
     validateInputs();
   }
 
   /**
    * @brief Executes the shell script if throttle conditions are met.
    * @return A string containing the output of the shell script execution or a message indicating throttle conditions.
+   * @throws std::runtime_error if the script failed or timed out.
    */
   std::string execute() {
+    ScriptRun r = run();
+    if (!r.executed) {
+      return r.summary();
+    }
+    if (r.timed_out) {
+      throw std::runtime_error("Script timed out after " +
+                               std::to_string(capture.timeout.count()) +
+                               " ms, process group killed");
+    }
+    if (!r.ok()) {
+      throw std::runtime_error("Script execution failed: " + r.summary());
+    }
+    return std::move(r.output);
+  }
+
+  /**
+   * @brief Runs the script if throttle conditions are met, streaming its
+   * output lines to the line sink.
+   * @return The outcome; a failed script is not an exception here.
+   */
+  ScriptRun run() {
     auto now = std::chrono::system_clock::now().time_since_epoch();
     auto now_seconds =
         std::chrono::duration_cast<std::chrono::seconds>(now).count();
 
-    if (time_last_executed == 0 ||
-        now_seconds >= time_last_executed + time_throttle) {
-      time_last_executed = now_seconds;
-      return executeScript();
-    } else {
-      return "Throttle time not reached. Script not executed.";
+    // pool workers may run one executor at once: only the thread whose
+    // compare-exchange claims the throttle window runs the script
+    long long last = time_last_executed.seconds.load();
+    while (last == 0 || now_seconds >= last + time_throttle) {
+      if (time_last_executed.seconds.compare_exchange_weak(last, now_seconds)) {
+        return executeScript();
+      }
     }
+    return ScriptRun{};
   }
+
+  /**
+   * @brief Sets the byte cap and timeout for each run.
+   */
+  void setCaptureLimits(const ScriptCapture::Limits &limits) {
+    capture = limits;
+  }
+
+  /**
+   * @brief Gets each line of stdout and stderr as the script writes it.
+   */
+  void setLineSink(ScriptCapture::LineSink sink) { line_sink = std::move(sink); }
+
   /**
    * @brief Checks the validity of the shell environment.
    * @return True if the shell environment is valid, otherwise false.
    */
   bool isShellgood() { return shell_good; }
 
+  Launcher getLauncher() const { return launcher; }
+
 private:
+  /**
+   * @brief Time of the last run, an atomic that copies with the executor.
+   */
+  struct RunStamp {
+    std::atomic<long long> seconds{0};
+
+    RunStamp() = default;
+    RunStamp(const RunStamp &o) : seconds(o.seconds.load()) {}
+    RunStamp &operator=(const RunStamp &o) {
+      seconds = o.seconds.load();
+      return *this;
+    }
+  };
+
+  /**
+   * @brief argv and envp for the script, built once so starting it does
+   * not allocate.  Shared, read-only, by copies of the executor.
+   */
+  struct ExecArgs {
+    std::vector<std::string> strings;
+    std::vector<char *> argv;
+    std::vector<char *> envp;
+
+    ExecArgs(const std::string &path, const std::vector<std::string> &args) {
+      size_t nenv = 0;
+      while (environ != nullptr && environ[nenv] != nullptr) {
+        nenv++;
+      }
+      strings.reserve(1 + args.size() + nenv);
+      strings.push_back(path);
+      strings.insert(strings.end(), args.begin(), args.end());
+      for (size_t i = 0; i < nenv; i++) {
+        strings.emplace_back(environ[i]);
+      }
+      for (size_t i = 0; i < strings.size(); i++) {
+        auto &v = (i <= args.size()) ? argv : envp;
+        v.push_back(strings[i].data());
+      }
+      argv.push_back(nullptr);
+      envp.push_back(nullptr);
+    }
+
+    ExecArgs(const ExecArgs &) = delete;
+    ExecArgs &operator=(const ExecArgs &) = delete;
+  };
+
   std::string scriptPath;  /**< The path to the shell script. */
   std::vector<std::string> args;  /**< The arguments to be passed to the shell script. */
   int time_throttle;  /**< The time throttle in seconds to control script execution frequency. */
-  long long time_last_executed;   /**< The timestamp of the last script execution. */
+  RunStamp time_last_executed;   /**< The timestamp of the last script execution. */
   struct stat fileStat;  /**< A struct to hold file status information. */
+  Launcher launcher;  /**< posix_spawn or fork+exec. */
+  std::shared_ptr<const ExecArgs> exec;  /**< Precomputed argv/envp. */
+  ScriptCapture::Limits capture;  /**< Byte cap and timeout of a run. */
+  ScriptCapture::LineSink line_sink;  /**< Where output lines go. */
 
 /**
    * @brief Executes the shell script and captures the output.
@@ -80,50 +241,116 @@ private:
   }
   // Add more validation as needed
 
-  std::string executeScript() const {
-    int pipefd[2];
-    if (pipe(pipefd) == -1) {
-      throw std::runtime_error("pipe() failed");
+  ScriptRun executeScript() const {
+    ScriptCapture capturer(capture, line_sink);
+    ScriptCapture::Outcome out;
+    ScriptRun r;
+    r.executed = true;
+
+    bool launched = false;
+    if (launcher == Launcher::zygote && zygote().isRunning()) {
+      try {
+        Zygote::Child child = zygote().launch(exec->argv.data());
+        launched = true;
+        out = capturer.run(child.pid, child.out_fd, child.err_fd,
+                           child.reply_fd);
+        r.status = zygote().wait(child);
+      } catch (const Zygote::Stopped &) {
+        // it died since the check; this run and the next use spawn
+      }
+    }
+    if (!launched) {
+      // close-on-exec so concurrent runs do not leak each other's pipes
+      int outpipe[2];
+      int errpipe[2];
+      if (pipe2(outpipe, O_CLOEXEC) == -1) {
+        throw std::runtime_error("pipe() failed");
+      }
+      if (pipe2(errpipe, O_CLOEXEC) == -1) {
+        close(outpipe[0]);
+        close(outpipe[1]);
+        throw std::runtime_error("pipe() failed");
+      }
+
+      pid_t pid;
+      try {
+        pid = (launcher == Launcher::fork) ? forkChild(outpipe, errpipe)
+                                           : spawnChild(outpipe, errpipe);
+      } catch (...) {
+        for (int fd : {outpipe[0], outpipe[1], errpipe[0], errpipe[1]}) {
+          close(fd);
+        }
+        throw;
+      }
+      close(outpipe[1]); // Close write ends
+      close(errpipe[1]);
+
+      int exit_fd = ScriptCapture::exitFd(pid);
+      out = capturer.run(pid, outpipe[0], errpipe[0], exit_fd);
+      if (exit_fd >= 0) {
+        close(exit_fd);
+      }
+      while (waitpid(pid, &r.status, 0) < 0 && errno == EINTR) {
+      }
     }
 
+    r.timed_out = out.timed_out;
+    r.truncated = out.truncated;
+    r.bytes = out.bytes;
+    r.output = std::move(out.output);
+    return r;
+  }
+
+  // stdout and stderr go to the pipes, the script leads its own process
+  // group so a timeout can kill everything it started; the daemon blocks
+  // the signals its event loop reads from a signalfd, the script gets the
+  // default mask
+  pid_t spawnChild(const int outpipe[2], const int errpipe[2]) const {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, outpipe[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, errpipe[1], STDERR_FILENO);
+    posix_spawnattr_init(&attr);
+    sigset_t none;
+    sigemptyset(&none);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK |
+                                        POSIX_SPAWN_SETPGROUP);
+
+    pid_t pid;
+    int rc = posix_spawnp(&pid, exec->argv[0], &actions, &attr,
+                          exec->argv.data(), exec->envp.data());
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0) {
+      throw std::runtime_error(std::string("posix_spawn() failed: ") +
+                               strerror(rc));
+    }
+    return pid;
+  }
+
+  pid_t forkChild(const int outpipe[2], const int errpipe[2]) const {
     pid_t pid = fork();
     if (pid == -1) {
       throw std::runtime_error("fork() failed");
     }
 
-    if (pid == 0) {                   // Child process
-      close(pipefd[0]);               // Close read end
-      dup2(pipefd[1], STDOUT_FILENO); // Redirect stdout to pipe
-      close(pipefd[1]);
-
-      std::vector<char *> execArgs;
-      execArgs.push_back(const_cast<char *>(scriptPath.c_str()));
-      for (const auto &arg : args) {
-        execArgs.push_back(const_cast<char *>(arg.c_str()));
-      }
-      execArgs.push_back(nullptr);
+    if (pid == 0) { // Child process
+      setpgid(0, 0);
+      sigset_t none;
+      sigemptyset(&none);
+      sigprocmask(SIG_SETMASK, &none, nullptr);
+      dup2(outpipe[1], STDOUT_FILENO); // Redirect stdout to pipe
+      dup2(errpipe[1], STDERR_FILENO);
 
-      execvp(scriptPath.c_str(), execArgs.data());
+      // no allocation between fork and exec: other threads may have held
+      // the malloc lock when the daemon forked
+      execvp(exec->argv[0], exec->argv.data());
       _exit(EXIT_FAILURE); // execvp failed
-    } else {               // Parent process
-      close(pipefd[1]);    // Close write end
-
-      std::array<char, 128> buffer;
-      std::string result;
-      ssize_t count;
-      while ((count = read(pipefd[0], buffer.data(), buffer.size())) > 0) {
-        result.append(buffer.data(), count);
-      }
-      close(pipefd[0]);
-
-      int status;
-      waitpid(pid, &status, 0);
-      if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
-        throw std::runtime_error("Script execution failed with status " +
-                                 std::to_string(WEXITSTATUS(status)));
-      }
-
-      return result;
     }
+    setpgid(pid, pid); // either side may get there first
+    return pid;
   }
 };
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+// PASS/FAIL reporting for the test programs in src/: each check() prints
+// one line, testResult() the verdict and the program's exit status.
+
+inline int &testFailures() {
+  static int failures = 0;
+  return failures;
+}
+
+inline void check(bool cond, const std::string &what) {
+  std::cout << (cond ? "PASS: " : "FAIL: ") << what << std::endl;
+  if (!cond) {
+    ++testFailures();
+  }
+}
+
+inline int testResult() {
+  std::cout << (testFailures() == 0 ? "all passed" : "FAILED") << std::endl;
+  return testFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,471 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <sys/timerfd.h>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class TimerWheel
+ * @brief Drives any number of periodic and one-shot jobs from one thread.
+ *
+ * Timers live in a hierarchical timing wheel: 4 levels of 64 slots, level 0
+ * one tick per slot, each level above 64 times coarser.  Adding or
+ * cancelling a timer is O(1).  The thread does not tick through idle time,
+ * it sleeps until the next occupied slot (found from a per-level occupancy
+ * bitmap), so the number of wakeups follows the number of expiries and not
+ * the tick rate.
+ *
+ * Jobs run on the wheel thread, one at a time; a job returns false to stop
+ * repeating.  With pollFd() the wheel has no thread of its own: an event
+ * loop waits on its timerfd and calls dispatch().  Periodic jobs are
+ * rescheduled from their previous deadline, so they do not drift by the
+ * time the job took.
+ */
+class TimerWheel {
+public:
+  using Id = uint64_t;
+  using Job = std::function<bool()>;
+  using clock = std::chrono::steady_clock;
+
+  explicit TimerWheel(
+      std::chrono::nanoseconds tick = std::chrono::milliseconds(10))
+      : tick_(tick.count() > 0 ? tick : std::chrono::milliseconds(10)),
+        start_(clock::now()) {}
+
+  ~TimerWheel() {
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    if (timer_fd_ >= 0) {
+      ::close(timer_fd_);
+    }
+  }
+
+  TimerWheel(const TimerWheel &) = delete;
+  TimerWheel &operator=(const TimerWheel &) = delete;
+
+  /**
+   * @brief Runs job after delay, then every period (0 = one-shot).
+   * @return Id for cancel() and setPeriod().
+   */
+  Id schedule(Job job, std::chrono::nanoseconds delay,
+              std::chrono::nanoseconds period = std::chrono::nanoseconds(0)) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (timer_fd_ < 0 && !thread_.joinable()) {
+      thread_ = std::thread(&TimerWheel::run, this);
+    }
+    Id id = ++last_id_;
+    Entry &entry = entries_[id];
+    entry.job = std::move(job);
+    entry.period = (period.count() > 0) ? toTicks(period) : 0;
+    entry.expires = std::max(ticksAt(clock::now() + delay), now_tick_ + 1);
+    insert(id, entry.expires);
+    if (timer_fd_ >= 0) {
+      armTimerFd();
+    } else {
+      cv_.notify_all();
+    }
+    return id;
+  }
+
+  /**
+   * @brief Hands the wheel to an event loop: no thread is started, the
+   * returned timerfd is kept armed for the next expiry instead.  Call
+   * before the first schedule(), and call dispatch() when it is readable.
+   * @return The timerfd, -1 on failure.
+   */
+  int pollFd() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (timer_fd_ < 0 && !thread_.joinable()) {
+      timer_fd_ = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    }
+    return timer_fd_;
+  }
+
+  // Runs the jobs that are due; the pollFd() counterpart of the thread.
+  void dispatch() {
+    uint64_t expirations;
+    ssize_t rc = ::read(timer_fd_, &expirations, sizeof(expirations));
+    (void)rc;
+    std::unique_lock<std::mutex> lock(mtx_);
+    ++wakeups_;
+    runDue(lock);
+    armTimerFd();
+  }
+
+  /**
+   * @brief Removes a timer.  If its job is running on the wheel thread,
+   * waits for it to return, unless called from that job.
+   * @return false if the timer had already expired or been cancelled.
+   */
+  bool cancel(Id id) {
+    std::unique_lock<std::mutex> lock(mtx_);
+    bool found = entries_.erase(id) != 0;
+    if (running_ == id && std::this_thread::get_id() != running_thread_) {
+      done_cv_.wait(lock, [&] { return running_ != id; });
+    }
+    return found;
+  }
+
+  // Changes the period from the next cycle on.
+  bool setPeriod(Id id, std::chrono::nanoseconds period) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = entries_.find(id);
+    if (it == entries_.end()) {
+      return false;
+    }
+    it->second.period = (period.count() > 0) ? toTicks(period) : 0;
+    return true;
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return entries_.size();
+  }
+
+  uint64_t wakeups() const { return wakeups_; }
+  uint64_t fired() const { return fired_; }
+
+private:
+  static constexpr int levels = 4;
+  static constexpr int slot_bits = 6;
+  static constexpr uint64_t slots = 1 << slot_bits;
+  static constexpr uint64_t slot_mask = slots - 1;
+  static constexpr uint64_t max_span = (uint64_t(1) << (levels * slot_bits)) - 1;
+
+  struct Entry {
+    Job job;
+    uint64_t expires = 0; // absolute tick
+    uint64_t period = 0;  // ticks, 0 = one-shot
+  };
+
+  struct Level {
+    std::array<std::vector<Id>, slots> slot;
+    uint64_t occupied = 0; // bit per non-empty slot
+  };
+
+  uint64_t toTicks(std::chrono::nanoseconds d) const {
+    uint64_t t = static_cast<uint64_t>((d.count() + tick_.count() - 1) /
+                                       tick_.count());
+    return t > 0 ? t : 1;
+  }
+
+  uint64_t ticksAt(clock::time_point t) const {
+    auto since = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        t - start_);
+    return since.count() <= 0 ? 0 : toTicks(since);
+  }
+
+  clock::time_point timeOf(uint64_t tick) const { return start_ + tick * tick_; }
+
+  // Level and slot follow from how far away the expiry is; expiries beyond
+  // the top level wait in its farthest slot and are placed again when it
+  // cascades.
+  void insert(Id id, uint64_t expires) {
+    uint64_t delta = expires - now_tick_;
+    if (delta > max_span) {
+      delta = max_span;
+      expires = now_tick_ + delta;
+    }
+    int level = 0;
+    while (level < levels - 1 &&
+           delta >= (uint64_t(1) << ((level + 1) * slot_bits))) {
+      ++level;
+    }
+    uint64_t index = (expires >> (level * slot_bits)) & slot_mask;
+    wheel_[level].slot[index].push_back(id);
+    wheel_[level].occupied |= uint64_t(1) << index;
+  }
+
+  std::vector<Id> take(int level, uint64_t index) {
+    std::vector<Id> ids;
+    ids.swap(wheel_[level].slot[index]);
+    wheel_[level].occupied &= ~(uint64_t(1) << index);
+    return ids;
+  }
+
+  // First tick after now_tick_ at which an occupied slot is processed or
+  // cascaded, 0 if the wheel is empty.
+  uint64_t nextEvent() const {
+    uint64_t best = 0;
+    for (int level = 0; level < levels; level++) {
+      uint64_t bits = wheel_[level].occupied;
+      if (bits == 0) {
+        continue;
+      }
+      int shift = level * slot_bits;
+      uint64_t unit = now_tick_ >> shift;
+      uint64_t cur = unit & slot_mask;
+      // slots after the current one are this rotation, the rest the next
+      uint64_t ahead = (cur == slot_mask) ? 0 : bits & (~uint64_t(0) << (cur + 1));
+      uint64_t base = unit - cur;
+      uint64_t target = ahead ? base + __builtin_ctzll(ahead)
+                              : base + slots + __builtin_ctzll(bits);
+      uint64_t tick = target << shift;
+      if (best == 0 || tick < best) {
+        best = tick;
+      }
+    }
+    return best;
+  }
+
+  // Moves now_tick_ to tick, cascading coarser slots that come due, and
+  // returns the ids in the level 0 slot for tick.  The caller makes sure no
+  // occupied slot lies in between.
+  std::vector<Id> advanceTo(uint64_t tick) {
+    now_tick_ = tick;
+    for (int level = 1; level < levels; level++) {
+      int shift = level * slot_bits;
+      if ((tick & ((uint64_t(1) << shift) - 1)) != 0) {
+        break;
+      }
+      for (Id id : take(level, (tick >> shift) & slot_mask)) {
+        auto it = entries_.find(id);
+        if (it != entries_.end()) {
+          reinsert(id, it->second.expires);
+        }
+      }
+    }
+    return take(0, tick & slot_mask);
+  }
+
+  void reinsert(Id id, uint64_t expires) {
+    if (expires <= now_tick_) {
+      wheel_[0].slot[now_tick_ & slot_mask].push_back(id);
+      wheel_[0].occupied |= uint64_t(1) << (now_tick_ & slot_mask);
+    } else {
+      insert(id, expires);
+    }
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mtx_);
+    while (!stop_) {
+      uint64_t next = nextEvent();
+      if (next == 0) {
+        cv_.wait(lock);
+        ++wakeups_;
+        continue;
+      }
+      if (clock::now() < timeOf(next)) {
+        cv_.wait_until(lock, timeOf(next));
+        ++wakeups_;
+        // a timer may have been added in front of the one we slept for
+        continue;
+      }
+      runDue(lock);
+    }
+  }
+
+  void runDue(std::unique_lock<std::mutex> &lock) {
+    for (;;) {
+      uint64_t next = nextEvent();
+      if (next == 0 || clock::now() < timeOf(next)) {
+        return;
+      }
+      for (Id id : advanceTo(next)) {
+        fire(id, lock);
+      }
+    }
+  }
+
+  // Absolute CLOCK_MONOTONIC deadline, which is what steady_clock reads.
+  void armTimerFd() {
+    struct itimerspec its = {};
+    uint64_t next = nextEvent();
+    if (next != 0) {
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    timeOf(next).time_since_epoch())
+                    .count();
+      its.it_value.tv_sec = static_cast<time_t>(ns / 1000000000);
+      its.it_value.tv_nsec = static_cast<long>(ns % 1000000000);
+    }
+    ::timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &its, nullptr);
+  }
+
+  void fire(Id id, std::unique_lock<std::mutex> &lock) {
+    auto it = entries_.find(id);
+    if (it == entries_.end()) {
+      return; // cancelled
+    }
+    if (it->second.expires > now_tick_) {
+      insert(id, it->second.expires);
+      return;
+    }
+    Job job = it->second.job;
+    running_ = id;
+    running_thread_ = std::this_thread::get_id();
+    lock.unlock();
+    bool again = false;
+    try {
+      again = job();
+    } catch (...) {
+      again = true;
+    }
+    lock.lock();
+    running_ = 0;
+    ++fired_;
+    done_cv_.notify_all();
+
+    it = entries_.find(id);
+    if (it == entries_.end()) {
+      return;
+    }
+    if (!again || it->second.period == 0) {
+      entries_.erase(it);
+      return;
+    }
+    it->second.expires =
+        std::max(it->second.expires + it->second.period, now_tick_ + 1);
+    insert(id, it->second.expires);
+  }
+
+  const std::chrono::nanoseconds tick_;
+  const clock::time_point start_;
+  std::array<Level, levels> wheel_;
+  std::unordered_map<Id, Entry> entries_;
+  uint64_t now_tick_ = 0;
+  Id last_id_ = 0;
+  Id running_ = 0;
+  std::thread::id running_thread_;
+  int timer_fd_ = -1; // pollFd() mode
+  uint64_t wakeups_ = 0;
+  uint64_t fired_ = 0;
+  bool stop_ = false;
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+  std::condition_variable done_cv_;
+  std::thread thread_;
+};
+
+// The wheel WheelTimers use unless they are given one.
+inline TimerWheel &timerWheel() {
+  static TimerWheel wheel;
+  return wheel;
+}
+
+/**
+ * @class WheelTimer
+ * @brief hmta::TimerAlarm work-alike that runs on a TimerWheel instead of a
+ * thread of its own.
+ *
+ * Same constructor, arm(), disarm(), set_time_interval(), is_armed() and
+ * current_repeat_count(): created disarmed, arming an armed timer throws,
+ * disarming a disarmed one is fine, a new interval applies from the next
+ * cycle, and the destructor waits for a running functor.
+ */
+template <std::invocable F> class WheelTimer {
+public:
+  using time_type = time_t;
+  using size_type = std::size_t;
+
+  static constexpr size_type FOREVER = size_type(-1);
+
+  WheelTimer(F &functor, time_type interval_sec, time_type interval_nanosec = 0,
+             size_type repeat_count = FOREVER)
+      : WheelTimer(timerWheel(), functor, interval_sec, interval_nanosec,
+                   repeat_count) {}
+
+  WheelTimer(TimerWheel &wheel, F &functor, time_type interval_sec,
+             time_type interval_nanosec = 0, size_type repeat_count = FOREVER)
+      : wheel_(wheel), functor_(functor), repeat_count_(repeat_count) {
+    if (repeat_count_ == 0) {
+      throw std::runtime_error("WheelTimer: repeat count must be greater "
+                               "than zero.");
+    }
+    set_time_interval(interval_sec, interval_nanosec);
+  }
+
+  WheelTimer(const WheelTimer &) = delete;
+  WheelTimer &operator=(const WheelTimer &) = delete;
+
+  ~WheelTimer() { disarm(); }
+
+  bool arm() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (armed_) {
+      throw std::runtime_error("WheelTimer::arm(): the timer is already "
+                               "armed.");
+    }
+    armed_ = true;
+    repeated_sofar_ = 0;
+    id_ = wheel_.schedule([this] { return tick(); }, interval_, interval_);
+    return true;
+  }
+
+  bool disarm() {
+    TimerWheel::Id id;
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      armed_ = false;
+      id = id_;
+      id_ = 0;
+    }
+    if (id != 0) {
+      wheel_.cancel(id);
+    }
+    return true;
+  }
+
+  bool set_time_interval(time_type interval_sec,
+                         time_type interval_nanosec = 0) {
+    if (interval_sec <= 0 && interval_nanosec <= 0) {
+      throw std::runtime_error("WheelTimer::set_time_interval(): the time "
+                               "interval must be greater than zero nano "
+                               "seconds.");
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    interval_ = std::chrono::seconds(interval_sec) +
+                std::chrono::nanoseconds(interval_nanosec);
+    if (id_ != 0) {
+      wheel_.setPeriod(id_, interval_);
+    }
+    return true;
+  }
+
+  bool is_armed() const noexcept { return armed_; }
+  size_type current_repeat_count() const noexcept { return repeated_sofar_; }
+
+private:
+  bool tick() {
+    if (!armed_) {
+      return false;
+    }
+    repeated_sofar_ += 1;
+    functor_();
+    if (repeated_sofar_ >= repeat_count_) {
+      std::lock_guard<std::mutex> lock(mtx_);
+      armed_ = false;
+      id_ = 0;
+      return false;
+    }
+    return true;
+  }
+
+  TimerWheel &wheel_;
+  F &functor_;
+  const size_type repeat_count_;
+  std::chrono::nanoseconds interval_{0};
+  std::atomic<bool> armed_{false};
+  std::atomic<size_type> repeated_sofar_{0};
+  TimerWheel::Id id_ = 0;
+  std::mutex mtx_;
+};
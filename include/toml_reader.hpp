@@ -1,3 +1,4 @@
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -10,6 +11,7 @@ struct Program {
     std::string user;
     int interval_seconds;
     std::string status;
+    int max_interval_seconds = 0; // > interval_seconds: adaptive interval
 };
 
 struct Script {
@@ -17,6 +19,41 @@ struct Script {
     std::string pgm;
     std::string options;
     int throttle_seconds;
+    std::string action = "script"; // or a native action: signal, restart,
+                                   // append, touch, notify
+    std::string signal;            // signal: name or number
+    std::vector<std::string> command; // restart: argv
+    std::string file;              // append, touch
+    std::string target;            // notify: udp:host:port or unix:/path
+    std::string message;           // append, notify
+};
+
+// Optional [monitor] section, every key has a default.
+struct Monitor {
+    bool process_events = false;  // use the netlink process connector
+    bool pidfd_liveness = false;  // wait on a pidfd of the matched process
+    bool incremental_scan = false; // keep a (pid, starttime) keyed table
+    std::string proc_root = "/proc"; // procfs to scan
+    double interval_growth = 2.0;  // adaptive interval factor while stable
+    int churn_threshold = 3;       // process events that reset the interval
+    int coalesce_window_ms = 500;  // how early a check may share a scan
+    int action_workers = 2;        // script threads, 0 only without scripts
+    int action_queue = 16;         // queued script runs
+    std::string action_overflow = "reject"; // or drop_oldest
+    int action_concurrency = 1;    // runs of one watch's script at a time
+    std::string script_launcher = "spawn"; // or fork, zygote
+    int script_timeout_seconds = 60; // then the script is killed, 0: none
+    int script_output_limit = 65536; // bytes of output logged per run
+    bool log_async = false;        // queue log lines for a writer thread
+    int log_flush_ms = 200;        // longest a queued line waits
+    int log_queue = 8192;          // queued lines before loggers wait
+    int log_compress_level = 6;    // zlib level for rotated logs, 1-9
+    std::string log_rotate = "daily"; // or hourly, none
+    int64_t log_max_bytes = 0;     // rotate at this size, 0: no limit
+    int log_max_age_minutes = 0;   // rotate at this age, 0: no limit
+    int log_keep_files = 0;        // rotated logs kept, 0: no limit
+    int log_keep_days = 10;        // older rotated logs deleted, 0: never
+    std::string log_format = "text"; // or json, binary
 };
 
 class TomlParser {
@@ -30,6 +67,7 @@ public:
 
     const std::vector<Program>& getPrograms() const { return programs_; }
     const std::vector<Script>& getScripts() const { return scripts_; }
+    const Monitor& getMonitor() const { return monitor_; }
 
 private:
     bool fileExists(const std::string &file_path) {
@@ -43,20 +81,11 @@ void parse(const std::string &file_path) {
         //  std::cout << "parse entry \n";
         int max_entries = 0;
 
-        // Wrap the entry counting in its own try-catch
         auto program_section = toml::find(data, "program");
-        try {
-             for ( int i = 0; i < 10 ; i++ ) {
-                    
-                   std::string suffix = (i == 0) ? "" : std::to_string(i); 
-                   // std::cout << "max " << suffix << "\n";
-                   auto test1 = toml::find<std::string>(program_section,"pgm" + suffix);
-                   // std::cout << "max " << suffix << "\n";
-                    ++max_entries;
-                }
-         } catch (const std::out_of_range &e) {
-               // std::cout << "max_entries: " << max_entries << std::endl;
-                         // You can choose to handle this error or continue parsing the rest.
+        // Count the pgm, pgm1, pgm2 ... keys; there is no fixed limit.
+        while (program_section.contains(
+                   "pgm" + (max_entries == 0 ? std::string() : std::to_string(max_entries)))) {
+            ++max_entries;
         }
 
         // Parse each program entry based on the maximum entries determined
@@ -69,6 +98,7 @@ void parse(const std::string &file_path) {
             program.user = toml::find<std::string>(program_section, "user" + suffix);
             program.interval_seconds = toml::find<int>(program_section, "interval_seconds" + suffix);
             program.status = toml::find<std::string>(program_section,  "status" + suffix);
+            program.max_interval_seconds = toml::find_or<int>(program_section, "max_interval_seconds" + suffix, 0);
 
             programs_.emplace_back(program);
         }
@@ -80,13 +110,49 @@ void parse(const std::string &file_path) {
             std::string suffix = (i == 0) ? "" : std::to_string(i);
             // std::cout << "script: " << i << "\n"; 
             Script script;
-            script.location = toml::find<std::string>(script_section, "location" + suffix);
-            script.pgm = toml::find<std::string>(script_section, "pgm" + suffix);
-            script.options = toml::find<std::string>(script_section, "options" + suffix);
+            script.action = toml::find_or<std::string>(script_section, "action" + suffix, "script");
+            if (script.action == "script") {
+                script.location = toml::find<std::string>(script_section, "location" + suffix);
+                script.pgm = toml::find<std::string>(script_section, "pgm" + suffix);
+                script.options = toml::find<std::string>(script_section, "options" + suffix);
+            }
             script.throttle_seconds = toml::find<int>(script_section, "throttle_seconds" + suffix);
+            script.signal = toml::find_or<std::string>(script_section, "signal" + suffix, "TERM");
+            script.command = toml::find_or<std::vector<std::string>>(script_section, "command" + suffix, {});
+            script.file = toml::find_or<std::string>(script_section, "file" + suffix, "");
+            script.target = toml::find_or<std::string>(script_section, "target" + suffix, "");
+            script.message = toml::find_or<std::string>(script_section, "message" + suffix, "tinypsmon {watch} {state} {pid}");
 
             scripts_.emplace_back(script);
         }
+
+        if (data.contains("monitor")) {
+            auto monitor_section = toml::find(data, "monitor");
+            monitor_.process_events = toml::find_or<bool>(monitor_section, "process_events", false);
+            monitor_.pidfd_liveness = toml::find_or<bool>(monitor_section, "pidfd_liveness", false);
+            monitor_.incremental_scan = toml::find_or<bool>(monitor_section, "incremental_scan", false);
+            monitor_.proc_root = toml::find_or<std::string>(monitor_section, "proc_root", "/proc");
+            monitor_.interval_growth = toml::find_or<double>(monitor_section, "interval_growth", 2.0);
+            monitor_.churn_threshold = toml::find_or<int>(monitor_section, "churn_threshold", 3);
+            monitor_.coalesce_window_ms = toml::find_or<int>(monitor_section, "coalesce_window_ms", 500);
+            monitor_.action_workers = toml::find_or<int>(monitor_section, "action_workers", 2);
+            monitor_.action_queue = toml::find_or<int>(monitor_section, "action_queue", 16);
+            monitor_.action_overflow = toml::find_or<std::string>(monitor_section, "action_overflow", "reject");
+            monitor_.action_concurrency = toml::find_or<int>(monitor_section, "action_concurrency", 1);
+            monitor_.script_launcher = toml::find_or<std::string>(monitor_section, "script_launcher", "spawn");
+            monitor_.script_timeout_seconds = toml::find_or<int>(monitor_section, "script_timeout_seconds", 60);
+            monitor_.script_output_limit = toml::find_or<int>(monitor_section, "script_output_limit", 65536);
+            monitor_.log_async = toml::find_or<bool>(monitor_section, "log_async", false);
+            monitor_.log_flush_ms = toml::find_or<int>(monitor_section, "log_flush_ms", 200);
+            monitor_.log_queue = toml::find_or<int>(monitor_section, "log_queue", 8192);
+            monitor_.log_compress_level = toml::find_or<int>(monitor_section, "log_compress_level", 6);
+            monitor_.log_rotate = toml::find_or<std::string>(monitor_section, "log_rotate", "daily");
+            monitor_.log_max_bytes = toml::find_or<int64_t>(monitor_section, "log_max_bytes", 0);
+            monitor_.log_max_age_minutes = toml::find_or<int>(monitor_section, "log_max_age_minutes", 0);
+            monitor_.log_keep_files = toml::find_or<int>(monitor_section, "log_keep_files", 0);
+            monitor_.log_keep_days = toml::find_or<int>(monitor_section, "log_keep_days", 10);
+            monitor_.log_format = toml::find_or<std::string>(monitor_section, "log_format", "text");
+        }
     } catch (const toml::syntax_error &e) {
         throw std::runtime_error("Syntax error in TOML file: " + std::string(e.what()));
     } catch (const std::out_of_range &e) {
@@ -98,5 +164,6 @@ void parse(const std::string &file_path) {
 
     std::vector<Program> programs_;
     std::vector<Script> scripts_;
+    Monitor monitor_;
 };
 
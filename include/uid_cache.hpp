@@ -0,0 +1,100 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <pwd.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unordered_map>
+
+/**
+ * @class UidCache
+ * @brief uid -> user name cache shared by the ProcessLister backends.
+ *
+ * getpwuid() can mean an NSS/LDAP round trip, so each uid is looked up once.
+ * The cache is dropped when the passwd file's mtime changes; the file is
+ * stat'ed at most once per second.
+ */
+class UidCache {
+public:
+  explicit UidCache(const std::string &passwd_file = "/etc/passwd")
+      : passwd_file_(passwd_file) {}
+
+  /**
+   * @brief User name for uid, "Unknown" if there is no passwd entry.
+   */
+  std::string name(uid_t uid) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    checkPasswd();
+    auto it = names_.find(uid);
+    if (it != names_.end()) {
+      ++hits_;
+      return it->second;
+    }
+    ++misses_;
+    struct passwd *pw = getpwuid(uid);
+    std::string user = (pw != nullptr) ? pw->pw_name : "Unknown";
+    names_.emplace(uid, user);
+    return user;
+  }
+
+  /**
+   * @brief Resolves a user name to its uid, used once at config load so the
+   * per-process comparison is an integer compare.
+   */
+  std::optional<uid_t> uid(const std::string &user) {
+    struct passwd *pw = getpwnam(user.c_str());
+    if (pw == nullptr) {
+      return std::nullopt;
+    }
+    return pw->pw_uid;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    names_.clear();
+  }
+
+  uint64_t hits() const { return hits_; }
+  uint64_t misses() const { return misses_; }
+  uint64_t invalidations() const { return invalidations_; }
+
+private:
+  void checkPasswd() {
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_check_ < std::chrono::seconds(1)) {
+      return;
+    }
+    last_check_ = now;
+    struct stat st;
+    if (stat(passwd_file_.c_str(), &st) != 0) {
+      return;
+    }
+    if (st.st_mtim.tv_sec != mtime_.tv_sec ||
+        st.st_mtim.tv_nsec != mtime_.tv_nsec) {
+      if (mtime_.tv_sec != 0 || mtime_.tv_nsec != 0) {
+        ++invalidations_;
+      }
+      mtime_ = st.st_mtim;
+      names_.clear();
+    }
+  }
+
+  std::string passwd_file_;
+  std::unordered_map<uid_t, std::string> names_;
+  std::chrono::steady_clock::time_point last_check_{};
+  struct timespec mtime_ = {0, 0};
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  uint64_t invalidations_ = 0;
+  std::mutex mtx_;
+};
+
+// The one cache every backend uses.
+inline UidCache &uidCache() {
+  static UidCache cache;
+  return cache;
+}
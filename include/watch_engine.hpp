@@ -0,0 +1,640 @@
+#pragma once
+
+#include "action_pool.hpp"
+#include "native_action.hpp"
+#include "process_matcher.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @class WatchEngine
+ * @brief Evaluates every configured Program/Script pair.
+ *
+ * Watches are grouped by interval and each group has a timer, but checks
+ * are coalesced: a group's tick checks every watch, of any group, that is
+ * due within the coalesce window, against one process snapshot and one
+ * CompiledMatcher pass.  Deadlines are phase-aligned to a common epoch, so
+ * 4 s, 8 s and 12 s watches come due together and share their scans, and
+ * the scan cost of N watches approaches that of one.  Each watch keeps its
+ * own found state and its own ShellScriptExecutor, and with it its own
+ * throttle.
+ *
+ * A watch with a max interval is adaptive: its group still ticks at the
+ * configured interval, but the watch is only checked once its effective
+ * interval has passed.  That interval grows by a factor per stable check,
+ * up to the max, and drops back to the configured one after a state change,
+ * a failed script or churn among processes of the watched name.
+ */
+class WatchEngine {
+public:
+  explicit WatchEngine(ProcessLister &lister) : ps_(lister) {}
+
+  WatchEngine(const WatchEngine &) = delete;
+  WatchEngine &operator=(const WatchEngine &) = delete;
+
+  // With a native action the shell is not used.
+  void addWatch(const std::string &name, const matchProcess &m,
+                bool desired_up, const ShellScriptExecutor &shell,
+                int interval_seconds, int max_interval_seconds = 0,
+                const std::optional<NativeAction> &native = std::nullopt) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    watches_.emplace_back(name, m, desired_up, shell, interval_seconds,
+                          max_interval_seconds);
+    watches_.back().native = native;
+    // script output is logged line by line while the script runs
+    watches_.back().shell.setLineSink(
+        [name](const std::string &line, bool is_stderr) {
+          logger.log(name + (is_stderr ? " stderr: " : " stdout: ") + line);
+        });
+    groups_[interval_seconds].push_back(watches_.size() - 1);
+    compiled_ = false;
+  }
+
+  // How early a watch may be checked to share another group's scan.
+  void setCoalesceWindow(std::chrono::milliseconds window) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    window_ = std::max(window, std::chrono::milliseconds(0));
+  }
+
+  // Adaptive intervals: growth factor per stable check and the number of
+  // same-name process starts between checks that counts as churn.
+  void setAdaptive(double growth, int churn_threshold) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    growth_ = std::max(1.0, growth);
+    churn_threshold_ = std::max(1, churn_threshold);
+  }
+
+  struct WatchStatus {
+    std::string name;
+    bool found;
+    int interval_seconds;     // configured, the minimum when adaptive
+    int max_interval_seconds; // 0 unless adaptive
+    int effective_seconds;    // what the watch is checked at right now
+  };
+
+  std::vector<WatchStatus> status() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    std::vector<WatchStatus> out;
+    for (const Watch &w : watches_) {
+      out.push_back(WatchStatus{w.name, w.found, w.interval_seconds,
+                                adaptive(w) ? w.max_interval_seconds : 0,
+                                w.effective_seconds});
+    }
+    return out;
+  }
+
+  void logStatus() {
+    for (const WatchStatus &st : status()) {
+      std::string line = "watch " + st.name + ": " +
+                         (st.found ? "found" : "not found") + ", interval " +
+                         std::to_string(st.effective_seconds) + "s";
+      if (st.max_interval_seconds > 0) {
+        line += " (adaptive " + std::to_string(st.interval_seconds) + "-" +
+                std::to_string(st.max_interval_seconds) + "s)";
+      }
+      logger.log(line);
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    logger.log("coalescing: " + std::to_string(scans_) + " scans for " +
+               std::to_string(scans_ + scans_saved_) + " group checks, " +
+               std::to_string(scans_saved_) + " scans saved");
+  }
+
+  uint64_t scans() const { return scans_; }
+  uint64_t scansSaved() const { return scans_saved_; }
+
+  /**
+   * @brief Builds the matchers, call once the config is loaded.  evaluate
+   * compiles on first use otherwise.
+   */
+  void compile() {
+    all_matcher_ = CompiledMatcher();
+    all_.clear();
+    by_name_.clear();
+    for (size_t i = 0; i < watches_.size(); i++) {
+      all_matcher_.add(watches_[i].match);
+      all_.push_back(i);
+      by_name_[watches_[i].match.process_name].push_back(i);
+    }
+    all_matcher_.compile();
+    epoch_ = std::chrono::steady_clock::now();
+    compiled_ = true;
+  }
+
+  std::vector<int> intervals() const {
+    std::vector<int> out;
+    for (const auto &group : groups_) {
+      out.push_back(group.first);
+    }
+    return out;
+  }
+
+  size_t size() const { return watches_.size(); }
+
+  /**
+   * @brief A group's tick: checks every watch due within the coalesce
+   * window against one shared snapshot.  This is what the interval's timer
+   * calls; it does nothing if an earlier tick already served the group.
+   */
+  void evaluateGroup(int interval_seconds) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!compiled_) {
+      compile();
+    }
+    if (groups_.find(interval_seconds) == groups_.end()) {
+      return;
+    }
+    // adaptive watches that backed off sit this tick out
+    auto now = std::chrono::steady_clock::now();
+    std::vector<bool> active(watches_.size(), false);
+    std::set<int> served; // groups this scan stands in for
+    for (size_t i = 0; i < watches_.size(); i++) {
+      if (now + window_ >= watches_[i].next_due) {
+        active[i] = true;
+        served.insert(watches_[i].interval_seconds);
+      }
+    }
+    if (served.empty()) {
+      return;
+    }
+    ++scans_;
+    scans_saved_ += served.size() - 1;
+    evaluate(all_, all_matcher_, active);
+  }
+
+#ifndef __FreeBSD__
+  void useProcessEvents(ProcEventMonitor &events) { events_ = &events; }
+  void useIncremental(ProcSnapshot &snapshot) { snapshot_ = &snapshot; }
+  void useLiveness(PidWatcher &liveness) { liveness_ = &liveness; }
+#endif
+
+  // Runs scripts on the pool instead of the thread doing the check.
+  void useActionPool(ActionPool &pool) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    pool_ = &pool;
+  }
+
+#ifndef __FreeBSD__
+  // Process connector listener: re-evaluate right away the watches whose
+  // matched pid exited or whose process name just exec'd.
+  void onProcessEvent(unsigned what, int pid, const ProcessInfo *proc) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    std::vector<size_t> hit;
+    for (size_t i = 0; i < watches_.size(); i++) {
+      Watch &w = watches_[i];
+      bool exec = what == proc_event::PROC_EVENT_EXEC && proc != nullptr &&
+                  proc->name == w.match.process_name;
+      if (exec) {
+        ++w.churn;
+      }
+      if (exec || (what == proc_event::PROC_EVENT_EXIT && w.last_pid == pid)) {
+        hit.push_back(i);
+      }
+    }
+    if (!hit.empty()) {
+      logger.log("process event for pid " + std::to_string(pid));
+      evaluateSubset(hit);
+    }
+  }
+
+  // Called from the liveness thread when a watched pid exits; rescan to
+  // look for a replacement instance.
+  void onPidExit(int pid) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (size_t i = 0; i < watches_.size(); i++) {
+      if (watches_[i].watched_pid == pid) {
+        logger.log("pidfd: pid " + std::to_string(pid) + " exited");
+        watches_[i].watched_pid = -1;
+        evaluateSubset({i});
+      }
+    }
+  }
+#endif
+
+private:
+  struct Watch {
+    Watch(const std::string &name, const matchProcess &match, bool desired_up,
+          const ShellScriptExecutor &shell, int interval_seconds,
+          int max_interval_seconds)
+        : name(name), match(match), desired_up(desired_up), shell(shell),
+          interval_seconds(interval_seconds),
+          max_interval_seconds(max_interval_seconds),
+          effective_seconds(interval_seconds) {}
+
+    std::string name;
+    matchProcess match;
+    bool desired_up;
+    ShellScriptExecutor shell;
+    std::optional<NativeAction> native; // runs instead of the shell
+    int interval_seconds;
+    int max_interval_seconds; // adaptive when above interval_seconds
+    int effective_seconds;
+    std::chrono::steady_clock::time_point next_due{};
+    size_t actions_in_flight = 0; // queued or running on the action pool
+    int churn = 0;        // same-name process starts since the last check
+    bool checked = false; // the fields below are from the last check
+    bool checked_found = false;
+    int checked_pid = -1;
+    bool found = false;
+    int last_pid = -1;
+    int watched_pid = -1; // pidfd liveness
+    ProcessInfo matched = {}; // last match, reported while the pidfd is alive
+  };
+
+  static bool adaptive(const Watch &w) {
+    return w.max_interval_seconds > w.interval_seconds;
+  }
+
+  void evaluateSubset(const std::vector<size_t> &due) {
+    if (!compiled_) {
+      compile();
+    }
+    CompiledMatcher matcher;
+    for (size_t i : due) {
+      matcher.add(watches_[i].match);
+    }
+    matcher.compile();
+    evaluate(due, matcher);
+  }
+
+  // matcher ids are positions in due; active, if given, picks the watches
+  // in due that are checked
+  void evaluate(const std::vector<size_t> &due, CompiledMatcher &matcher,
+                const std::vector<bool> &active = {}) {
+    // next checks count from here, not from when a long scan ends
+    tick_start_ = std::chrono::steady_clock::now();
+    std::vector<bool> pending(due.size(), false);
+    bool any_pending = false;
+    for (size_t k = 0; k < due.size(); k++) {
+      if (!active.empty() && !active[k]) {
+        continue;
+      }
+      Watch &w = watches_[due[k]];
+      if (aliveByPidfd(w)) {
+        // While the pidfd of the matched process is open it is still
+        // running, no need to walk /proc to find that out.
+        logger.log("pidfd: pid " + std::to_string(w.watched_pid) +
+                   " alive, scan skipped");
+        w.found = true;
+        adapt(w, act(w, &w.matched));
+      } else {
+        pending[k] = true;
+        any_pending = true;
+      }
+    }
+    if (!any_pending) {
+      return;
+    }
+
+#ifndef __FreeBSD__
+    bool from_events = events_ != nullptr && events_->isRunning();
+    if (!from_events && snapshot_ != nullptr) {
+      refreshIncremental();
+      for (size_t k = 0; k < due.size(); k++) {
+        if (pending[k]) {
+          Watch &w = watches_[due[k]];
+          finish(w, w.found ? snapshot_->find(w.last_pid) : nullptr);
+        }
+      }
+      return;
+    }
+#endif
+
+    // one snapshot and one matcher pass shared by every pending watch
+    std::vector<ProcessInfo> processes;
+#ifndef __FreeBSD__
+    if (from_events) {
+      processes = events_->getProcesses();
+    } else
+#endif
+    {
+      processes = stagedScan(matcher);
+    }
+    std::vector<const ProcessInfo *> hits = matcher.match(processes);
+    for (size_t k = 0; k < due.size(); k++) {
+      if (pending[k]) {
+        Watch &w = watches_[due[k]];
+        w.found = report(w, hits[k]);
+        w.last_pid = (hits[k] != nullptr) ? hits[k]->pid : -1;
+        finish(w, hits[k]);
+      }
+    }
+  }
+
+  // Logs like ProcessLister::searchProcess does and keeps its pid cache.
+  bool report(const Watch &w, const ProcessInfo *hit) {
+    if (hit != nullptr) {
+      logger.log(" matach -> " + w.match.argument);
+      logger.log(" match - user name: " + w.match.username);
+      logger.log(" match - process name: " + w.match.process_name);
+      ps_.setPidcache(hit->pid);
+      return true;
+    }
+    logger.log(" no match found -> process: " + w.match.process_name +
+               " user:  " + w.match.username);
+    ps_.flushPidcache();
+    return false;
+  }
+
+  std::vector<ProcessInfo> stagedScan(const CompiledMatcher &filter) {
+#ifndef __FreeBSD__
+    ScanStats stats;
+    std::vector<ProcessInfo> processes =
+        ps_.getMatchingProcesses(filter, stats);
+    logger.log("staged scan: pids " + std::to_string(stats.pids) + " name " +
+               std::to_string(stats.name_checks) + " uid " +
+               std::to_string(stats.uid_checks) + " args " +
+               std::to_string(stats.args_loaded) + " status reads avoided " +
+               std::to_string(stats.statusReadsAvoided()));
+    return processes;
+#else
+    (void)filter;
+    return ps_.getProcesses();
+#endif
+  }
+
+#ifndef __FreeBSD__
+  // Incremental mode: one refresh updates the state of every watch.  Only
+  // added processes can start a match; the whole in-memory table is only
+  // searched when a matched process went away.  A pid that was reused, or
+  // whose process exec'd, is in both delta lists, so a found watch whose
+  // pid is in removed is matched again even though the pid is still there.
+  void refreshIncremental() {
+    ProcDelta delta = snapshot_->refresh();
+    logger.log("incremental scan: +" + std::to_string(delta.added.size()) +
+               " -" + std::to_string(delta.removed.size()) + " parsed " +
+               std::to_string(delta.parsed) + " of " +
+               std::to_string(snapshot_->size()));
+    std::vector<const ProcessInfo *> added = snapshot_->select(delta.added);
+    for (const ProcessInfo *proc : added) {
+      auto named = by_name_.find(proc->name);
+      if (named != by_name_.end()) {
+        for (size_t i : named->second) {
+          ++watches_[i].churn;
+        }
+      }
+    }
+    std::vector<const ProcessInfo *> added_hits = all_matcher_.match(added);
+    std::vector<const ProcessInfo *> all_hits;
+    std::unordered_set<int> removed(delta.removed.begin(), delta.removed.end());
+    for (size_t i = 0; i < watches_.size(); i++) {
+      Watch &w = watches_[i];
+      const ProcessInfo *hit = nullptr;
+      if (w.found && w.last_pid > 0 && removed.count(w.last_pid) == 0 &&
+          snapshot_->find(w.last_pid)) {
+        continue;
+      }
+      if (w.found) {
+        if (all_hits.empty()) {
+          all_hits = all_matcher_.match(snapshot_->all());
+        }
+        hit = all_hits[i];
+      } else {
+        hit = added_hits[i];
+      }
+      bool was_found = w.found;
+      w.found = report(w, hit);
+      w.last_pid = (hit != nullptr) ? hit->pid : -1;
+      if (w.found != was_found) {
+        w.next_due = {}; // a backed-off watch is checked on its next tick
+      }
+    }
+  }
+#endif
+
+  bool aliveByPidfd(const Watch &w) {
+#ifndef __FreeBSD__
+    return liveness_ != nullptr && w.watched_pid > 0 &&
+           liveness_->isWatching(w.watched_pid);
+#else
+    (void)w;
+    return false;
+#endif
+  }
+
+  void finish(Watch &w, const ProcessInfo *hit) {
+    if (w.found == true) {
+      logger.log("process:  " + w.match.process_name + " found");
+    }
+#ifndef __FreeBSD__
+    if (liveness_ != nullptr) {
+      updateLiveness(w, hit);
+    }
+#endif
+    adapt(w, act(w, hit));
+  }
+
+  // Sets the watch's next check from its effective interval, which grows
+  // while nothing happens and drops to the configured one otherwise.
+  void adapt(Watch &w, bool script_failed) {
+    const char *reset = nullptr;
+    if (w.checked && w.found != w.checked_found) {
+      reset = "state change";
+    } else if (w.checked && w.found && w.last_pid != w.checked_pid) {
+      reset = "process restarted";
+    } else if (script_failed) {
+      reset = "script failed";
+    } else if (w.churn >= churn_threshold_) {
+      reset = "process churn";
+    }
+
+    if (adaptive(w)) {
+      int prev = w.effective_seconds;
+      if (reset != nullptr) {
+        w.effective_seconds = w.interval_seconds;
+      } else if (w.checked) {
+        // whole multiples of the group tick, which is the configured interval
+        int ticks = static_cast<int>(std::ceil(
+            prev * growth_ / static_cast<double>(w.interval_seconds)));
+        w.effective_seconds =
+            std::min(ticks, w.max_interval_seconds / w.interval_seconds) *
+            w.interval_seconds;
+      }
+      if (w.effective_seconds != prev) {
+        logger.log("adaptive: " + w.name + " interval " +
+                   std::to_string(prev) + "s -> " +
+                   std::to_string(w.effective_seconds) + "s" +
+                   (reset != nullptr ? std::string(" (") + reset + ")" : ""));
+      }
+    }
+
+    w.checked = true;
+    w.checked_found = w.found;
+    w.checked_pid = w.last_pid;
+    w.churn = 0;
+    scheduleNext(w, tick_start_);
+  }
+
+  // next multiple of the interval since the epoch after from, so watches
+  // whose intervals divide each other come due together; from is the start
+  // of the check, so a scan that runs long does not push the watch past
+  // its next tick
+  void scheduleNext(Watch &w, std::chrono::steady_clock::time_point from) {
+    auto every = std::chrono::seconds(w.effective_seconds);
+    auto slots = (from - epoch_ + window_) / every + 1;
+    w.next_due = epoch_ + slots * every;
+  }
+
+  // A script run on the pool failed after the check that started it.
+  void resetInterval(Watch &w, const char *reason) {
+    if (!adaptive(w) || w.effective_seconds == w.interval_seconds) {
+      return;
+    }
+    logger.log("adaptive: " + w.name + " interval " +
+               std::to_string(w.effective_seconds) + "s -> " +
+               std::to_string(w.interval_seconds) + "s (" + reason + ")");
+    w.effective_seconds = w.interval_seconds;
+    scheduleNext(w, std::chrono::steady_clock::now());
+  }
+
+#ifndef __FreeBSD__
+  void updateLiveness(Watch &w, const ProcessInfo *hit) {
+    int pid = (hit != nullptr) ? hit->pid : -1;
+    if (pid == w.watched_pid) {
+      return;
+    }
+    if (w.watched_pid > 0) {
+      liveness_->unwatch(w.watched_pid);
+    }
+    w.watched_pid = -1;
+    if (pid > 0 && liveness_->watch(pid)) {
+      w.watched_pid = pid;
+      w.matched = *hit;
+      logger.log("pidfd: watching pid " + std::to_string(pid));
+    }
+  }
+#endif
+
+  // Returns true if the script failed; with an action pool the script runs
+  // there and a failure is handled in onActionDone.
+  bool act(Watch &w, const ProcessInfo *hit) {
+    if (w.desired_up != w.found) {
+      return false;
+    }
+    if (hit != nullptr) {
+      ps_.logSingleProcess(*hit);
+    }
+    if (w.native) {
+      return actNative(w, hit);
+    }
+    std::cout << w.name << ": status change.. running script\n";
+    logger.log(w.name + ": status change.. running script");
+    if (pool_ != nullptr) {
+      submitAction(w);
+      return false;
+    }
+    try {
+      ScriptRun r = w.shell.run();
+      logger.log(w.name + (r.ok() ? ": script finished, " : ": script failed, ") +
+                 r.summary());
+      return !r.ok();
+    } catch (const std::exception &e) {
+      logger.log(w.name + ": script failed: " + e.what());
+      return true;
+    }
+  }
+
+  // Native actions are a system call or two, so they run right here.
+  bool actNative(Watch &w, const ProcessInfo *hit) {
+    logger.log(w.name + ": status change.. " + w.native->describe());
+    NativeAction::Event event{w.name, hit != nullptr ? hit->pid : -1, w.found};
+    try {
+      logger.log(w.name + ": " + w.native->execute(event));
+    } catch (const std::exception &e) {
+      logger.log(w.name + ": action failed: " + e.what());
+      return true;
+    }
+    return false;
+  }
+
+  // watches_ does not change once evaluation starts, so the index and the
+  // shell stay valid.  With action_concurrency above 1 several workers can
+  // run the same watch's shell at once; its throttle is claimed with a
+  // compare-exchange, so only one of them runs the script per window.
+  // While the watch already has its limit of runs queued or running, a
+  // check that finds it still wrong submits nothing: a slow or hung script
+  // must not fill the shared queue with stale runs of itself.
+  void submitAction(Watch &w) {
+    if (w.actions_in_flight >= pool_->perKeyLimit()) {
+      logger.log(w.name + ": script still queued or running, not queued again");
+      return;
+    }
+    size_t index = static_cast<size_t>(&w - watches_.data());
+    ShellScriptExecutor *shell = &w.shell;
+    bool queued = pool_->submit(
+        w.name,
+        [shell]() {
+          ScriptRun r = shell->run();
+          if (!r.ok()) {
+            throw std::runtime_error(r.summary());
+          }
+          return r.summary();
+        },
+        [this, index](const ActionPool::Result &r) { onActionDone(index, r); });
+    if (queued) {
+      ++w.actions_in_flight;
+    } else {
+      logger.log(w.name + ": action queue full, script not run");
+    }
+  }
+
+  void onActionDone(size_t index, const ActionPool::Result &r) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    Watch &w = watches_[index];
+    --w.actions_in_flight; // dropped requests complete here too
+    if (r.ok) {
+      logger.log(w.name + ": script finished in " +
+                 std::to_string(r.runtime.count()) + " ms, " + r.output);
+    } else {
+      logger.log(w.name + ": script failed: " + r.error);
+      resetInterval(w, "script failed");
+    }
+  }
+
+  ProcessLister &ps_;
+  std::vector<Watch> watches_;
+  std::map<int, std::vector<size_t>> groups_; // interval -> watches
+  std::vector<size_t> all_;                     // 0 .. watches_.size()-1
+  CompiledMatcher all_matcher_; // ids are indices in watches_
+  std::unordered_map<std::string, std::vector<size_t>> by_name_;
+  std::chrono::steady_clock::time_point epoch_ = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::time_point tick_start_ = epoch_; // of the check
+  std::chrono::milliseconds window_{500};
+  uint64_t scans_ = 0;
+  uint64_t scans_saved_ = 0;
+  double growth_ = 2.0;
+  int churn_threshold_ = 3;
+  bool compiled_ = false;
+  ActionPool *pool_ = nullptr;
+  std::mutex mtx_;
+#ifndef __FreeBSD__
+  ProcEventMonitor *events_ = nullptr;
+  ProcSnapshot *snapshot_ = nullptr;
+  PidWatcher *liveness_ = nullptr;
+#endif
+};
+
+// TimerAlarm functor that evaluates one interval group of a WatchEngine.
+class WatchGroupPoll {
+public:
+  WatchGroupPoll(WatchEngine &engine, int interval_seconds)
+      : engine_(engine), interval_seconds_(interval_seconds) {}
+
+  bool operator()() {
+    engine_.evaluateGroup(interval_seconds_);
+    return (true);
+  }
+
+private:
+  WatchEngine &engine_;
+  int interval_seconds_;
+};
@@ -0,0 +1,360 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <mutex>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @class Zygote
+ * @brief Small helper process, forked at startup while the daemon is still
+ * small, that starts scripts on the daemon's behalf.
+ *
+ * The daemon sends each launch request (the argv, and one end of a fresh
+ * socketpair for the reply) over a unix SOCK_SEQPACKET socketpair.  The
+ * zygote forks a launcher for the request, which forks and execs the
+ * script with stdout and stderr on pipes, passes the read ends back with
+ * SCM_RIGHTS, waits for the script and sends its exit status.  Every fork
+ * happens in a process the size of the daemon at startup, so the cost of a
+ * launch does not grow with the process table, the logger or the threads
+ * of the monitor.
+ *
+ * The zygote exits when the daemon closes its end of the socket or dies.
+ * If the zygote dies first (OOM kill, crash) the next launch finds the
+ * socket closed, reaps it and marks it stopped; launch() then throws
+ * Stopped and callers start their scripts some other way.
+ */
+class Zygote {
+public:
+  struct Child {
+    pid_t pid = -1;    // the script, also its process group
+    int out_fd = -1;   // read end of the script's stdout
+    int err_fd = -1;   // and of its stderr
+    int reply_fd = -1; // readable when the exit status has arrived
+  };
+
+  // launch() on a zygote that is not running
+  struct Stopped : std::runtime_error {
+    Stopped() : std::runtime_error("zygote: not running") {}
+  };
+
+  Zygote() = default;
+
+  ~Zygote() {
+    if (sock_ >= 0) {
+      ::close(sock_); // EOF makes the zygote exit
+      ::waitpid(pid_, nullptr, 0);
+    }
+  }
+
+  Zygote(const Zygote &) = delete;
+  Zygote &operator=(const Zygote &) = delete;
+
+  /**
+   * @brief Forks the helper.  Call it early, before threads are started
+   * and before signals are blocked.
+   */
+  bool start() {
+    if (sock_ >= 0) {
+      return true;
+    }
+    int sv[2];
+    if (::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+      return false;
+    }
+    pid_t pid = ::fork();
+    if (pid < 0) {
+      ::close(sv[0]);
+      ::close(sv[1]);
+      return false;
+    }
+    if (pid == 0) {
+      ::close(sv[0]);
+      serve(sv[1]);
+      _exit(0);
+    }
+    ::close(sv[1]);
+    sock_ = sv[0];
+    pid_ = pid;
+    running_ = true;
+    return true;
+  }
+
+  bool isRunning() const { return running_.load(); }
+
+  /**
+   * @brief Called once, with the zygote's wait status, if it is found dead.
+   */
+  void onStopped(std::function<void(int status)> fn) {
+    std::lock_guard<std::mutex> lock(send_mtx_);
+    on_stopped_ = std::move(fn);
+  }
+  pid_t pid() const { return pid_; }
+
+  /**
+   * @brief Starts argv (nullptr terminated) in the zygote.  Safe to call
+   * from several threads.
+   * @throws Stopped if the zygote is not running (any more),
+   * std::runtime_error if the launch failed.
+   */
+  Child launch(char *const argv[]) {
+    std::string request;
+    for (size_t i = 0; argv[i] != nullptr; i++) {
+      request.append(argv[i]);
+      request.push_back('\0');
+    }
+    if (request.size() > kMaxRequest) {
+      throw std::runtime_error("zygote: arguments too long");
+    }
+    int sv[2];
+    if (::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+      throw std::runtime_error("zygote: socketpair() failed");
+    }
+    bool sent = false;
+    int err = 0;
+    {
+      // the socket is only closed under this lock, so no launch sends on
+      // a descriptor that is being reused
+      std::lock_guard<std::mutex> lock(send_mtx_);
+      if (sock_ >= 0) {
+        sent = sendWithFds(sock_, request.data(), request.size(), &sv[1], 1);
+        err = errno;
+        if (!sent && (err == EPIPE || err == ECONNRESET)) {
+          stopLocked();
+        }
+      }
+    }
+    ::close(sv[1]);
+    if (!sent) {
+      ::close(sv[0]);
+      if (!isRunning()) {
+        throw Stopped();
+      }
+      throw std::runtime_error(std::string("zygote: send failed: ") +
+                               strerror(err));
+    }
+
+    Started started;
+    int fds[2] = {-1, -1};
+    ssize_t n = recvWithFds(sv[0], &started, sizeof(started), fds, 2);
+    if (n != static_cast<ssize_t>(sizeof(started)) || started.pid < 0 ||
+        fds[1] < 0) {
+      for (int fd : fds) {
+        if (fd >= 0) {
+          ::close(fd);
+        }
+      }
+      ::close(sv[0]);
+      if (n <= 0 && zygoteGone()) {
+        throw Stopped(); // it died with the request
+      }
+      throw std::runtime_error(
+          n == static_cast<ssize_t>(sizeof(started))
+              ? std::string("zygote: launch failed: ") + strerror(started.err)
+              : std::string("zygote: launcher died"));
+    }
+    return Child{started.pid, fds[0], fds[1], sv[0]};
+  }
+
+  /**
+   * @brief Waits for the script of a launch(); closes its reply_fd.
+   * @return Status as from waitpid().
+   */
+  int wait(Child &child) {
+    int32_t status = 0;
+    ssize_t n;
+    do {
+      n = ::recv(child.reply_fd, &status, sizeof(status), 0);
+    } while (n < 0 && errno == EINTR);
+    ::close(child.reply_fd);
+    child.reply_fd = -1;
+    if (n != static_cast<ssize_t>(sizeof(status))) {
+      throw std::runtime_error("zygote: launcher died");
+    }
+    return status;
+  }
+
+private:
+  static constexpr size_t kMaxRequest = 64 * 1024;
+
+  struct Started {
+    int32_t pid;
+    int32_t err; // errno of a failed pipe() or fork()
+  };
+
+  static constexpr size_t kMaxFds = 2;
+
+  // No reply at all: the launcher died, or the zygote did before forking
+  // it.  A dead zygote hangs up its socket as it exits.
+  bool zygoteGone() {
+    std::lock_guard<std::mutex> lock(send_mtx_);
+    if (sock_ < 0) {
+      return true;
+    }
+    struct pollfd pfd = {sock_, 0, 0};
+    if (::poll(&pfd, 1, 100) > 0 && (pfd.revents & (POLLHUP | POLLERR))) {
+      stopLocked();
+      return true;
+    }
+    return false;
+  }
+
+  // The zygote closed its end: it is gone.  Called with send_mtx_ held.
+  void stopLocked() {
+    running_ = false;
+    ::close(sock_);
+    sock_ = -1;
+    int status = 0;
+    while (::waitpid(pid_, &status, 0) < 0 && errno == EINTR) {
+    }
+    if (on_stopped_) {
+      on_stopped_(status);
+    }
+  }
+
+  static bool sendWithFds(int sock, const void *data, size_t len,
+                          const int *fds, size_t nfds) {
+    struct iovec iov = {const_cast<void *>(data), len};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(kMaxFds * sizeof(int))] = {};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (nfds > 0) {
+      msg.msg_control = control;
+      msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+      struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+      std::memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+    }
+    ssize_t n;
+    do {
+      n = ::sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    return n == static_cast<ssize_t>(len);
+  }
+
+  // fills fds[0 .. max) in the order sent, -1 for the ones not received
+  static ssize_t recvWithFds(int sock, void *data, size_t len, int *fds,
+                             size_t max) {
+    struct iovec iov = {data, len};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(kMaxFds * sizeof(int))] = {};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n;
+    do {
+      n = ::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    std::fill(fds, fds + max, -1);
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        size_t got = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        std::memcpy(fds, CMSG_DATA(cmsg), std::min(got, max) * sizeof(int));
+      }
+    }
+    return n;
+  }
+
+  // the zygote: one launcher process per request, reaped by the kernel
+  [[noreturn]] static void serve(int sock) {
+    ::signal(SIGCHLD, SIG_IGN);
+    std::vector<char> buf(kMaxRequest + 1);
+    for (;;) {
+      int reply = -1;
+      ssize_t n = recvWithFds(sock, buf.data(), kMaxRequest, &reply, 1);
+      if (n <= 0) {
+        _exit(0); // the daemon went away
+      }
+      if (reply < 0) {
+        continue;
+      }
+      pid_t pid = ::fork();
+      if (pid == 0) {
+        ::close(sock);
+        buf[n] = '\0';
+        runLauncher(reply, buf.data(), static_cast<size_t>(n));
+      }
+      ::close(reply);
+    }
+  }
+
+  // forks the script, hands back its stdout and stderr, reports its exit
+  // status
+  [[noreturn]] static void runLauncher(int reply, char *request, size_t len) {
+    ::signal(SIGCHLD, SIG_DFL); // so waitpid() sees the script
+    std::vector<char *> argv;
+    for (size_t i = 0; i < len; i += std::strlen(request + i) + 1) {
+      argv.push_back(request + i);
+    }
+    argv.push_back(nullptr);
+
+    Started started = {-1, 0};
+    int outpipe[2];
+    int errpipe[2];
+    if (::pipe2(outpipe, O_CLOEXEC) < 0 || ::pipe2(errpipe, O_CLOEXEC) < 0) {
+      started.err = errno;
+      sendWithFds(reply, &started, sizeof(started), nullptr, 0);
+      _exit(1);
+    }
+    pid_t pid = ::fork();
+    if (pid == 0) {
+      ::setpgid(0, 0);
+      sigset_t none;
+      sigemptyset(&none);
+      sigprocmask(SIG_SETMASK, &none, nullptr);
+      dup2(outpipe[1], STDOUT_FILENO);
+      dup2(errpipe[1], STDERR_FILENO);
+      execvp(argv[0], argv.data());
+      _exit(EXIT_FAILURE); // execvp failed
+    }
+    ::close(outpipe[1]);
+    ::close(errpipe[1]);
+    started.pid = pid;
+    started.err = (pid < 0) ? errno : 0;
+    int fds[2] = {outpipe[0], errpipe[0]};
+    sendWithFds(reply, &started, sizeof(started), fds, pid < 0 ? 0 : 2);
+    ::close(outpipe[0]);
+    ::close(errpipe[0]);
+    if (pid < 0) {
+      _exit(1);
+    }
+
+    int status = 0;
+    while (::waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    int32_t out = status;
+    ::send(reply, &out, sizeof(out), MSG_NOSIGNAL);
+    _exit(0);
+  }
+
+  int sock_ = -1;
+  pid_t pid_ = -1;
+  std::atomic<bool> running_{false};
+  std::mutex send_mtx_;
+  std::function<void(int status)> on_stopped_;
+};
+
+// The daemon's zygote; started by main when script_launcher is "zygote".
+inline Zygote &zygote() {
+  static Zygote instance;
+  return instance;
+}
@@ -0,0 +1,230 @@
+// bench
+// micro/macro benchmarks for the daemon's hot paths: the /proc scan, the
+// match, the logger, the script spawn and the config parse.  Prints a table
+// and writes the results as JSON so runs can be diffed between commits.
+//
+// usage: bench [--json FILE] [--proc-root DIR] [--iterations N]
+
+#include "logger.h"
+#include "shell.hpp"
+#include "toml_reader.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <set>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+// allocation counter for allocs/op
+static std::atomic<uint64_t> g_allocs{0};
+
+void *operator new(std::size_t size) {
+  g_allocs.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+// out of line so gcc does not pair the inlined free() with operator new
+__attribute__((noinline)) static void benchFree(void *p) { std::free(p); }
+void operator delete(void *p) noexcept { benchFree(p); }
+void operator delete(void *p, std::size_t) noexcept { benchFree(p); }
+
+// scratch directory for the log, config and script used by the benchmarks
+static std::string benchDir() {
+  static std::string dir = [] {
+    std::filesystem::path p =
+        std::filesystem::temp_directory_path() / "tinypsmon_bench";
+    std::filesystem::create_directories(p);
+    return p.string();
+  }();
+  return dir;
+}
+
+Logger logger(benchDir() + "/bench_global.log");
+#include "linux_process.hpp"
+
+struct BenchResult {
+  std::string name;
+  size_t iterations = 0;
+  double ns_per_op = 0;
+  double allocs_per_op = 0;
+  double p50_ns = 0;
+  double p99_ns = 0;
+};
+
+// Runs fn iterations times after a short warmup; each call is timed on its
+// own so the percentiles are per operation.
+template <typename Fn>
+static BenchResult runBench(const std::string &name, size_t iterations,
+                            Fn &&fn) {
+  for (size_t i = 0; i < std::min<size_t>(iterations / 10 + 1, 100); i++) {
+    fn();
+  }
+  std::vector<double> samples;
+  samples.reserve(iterations);
+  uint64_t allocs_before = g_allocs.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < iterations; i++) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    samples.push_back(
+        std::chrono::duration<double, std::nano>(elapsed).count());
+  }
+  uint64_t allocs = g_allocs.load(std::memory_order_relaxed) - allocs_before;
+
+  BenchResult r;
+  r.name = name;
+  r.iterations = iterations;
+  double total = 0;
+  for (double s : samples) {
+    total += s;
+  }
+  r.ns_per_op = total / iterations;
+  r.allocs_per_op = static_cast<double>(allocs) / iterations;
+  std::sort(samples.begin(), samples.end());
+  r.p50_ns = samples[samples.size() / 2];
+  r.p99_ns = samples[std::min(samples.size() - 1, samples.size() * 99 / 100)];
+  return r;
+}
+
+static void printResult(const BenchResult &r) {
+  std::cout << std::left << std::setw(28) << r.name << std::right
+            << std::setw(10) << r.iterations << std::fixed
+            << std::setprecision(0) << std::setw(14) << r.ns_per_op
+            << std::setprecision(1) << std::setw(12) << r.allocs_per_op
+            << std::setprecision(0) << std::setw(14) << r.p50_ns
+            << std::setw(14) << r.p99_ns << std::endl;
+}
+
+static void writeJson(const std::string &path,
+                      const std::vector<BenchResult> &results) {
+  std::ofstream out(path, std::ios::trunc);
+  out << "{\n  \"benchmarks\": [\n";
+  for (size_t i = 0; i < results.size(); i++) {
+    const BenchResult &r = results[i];
+    out << "    {\"name\": \"" << r.name << "\", \"iterations\": "
+        << r.iterations << std::fixed << std::setprecision(1)
+        << ", \"ns_per_op\": " << r.ns_per_op
+        << ", \"allocs_per_op\": " << r.allocs_per_op
+        << ", \"p50_ns\": " << r.p50_ns << ", \"p99_ns\": " << r.p99_ns
+        << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  out << "  ]\n}\n";
+}
+
+static std::string writeConfig(int programs) {
+  std::string path = benchDir() + "/config.toml";
+  std::ofstream out(path, std::ios::trunc);
+  out << "[program]\n";
+  for (int i = 0; i < programs; i++) {
+    std::string s = (i == 0) ? "" : std::to_string(i);
+    out << "pgm" << s << " = \"svc" << i << "\"\nparms" << s
+        << " = \"--config=/etc/svc" << i << ".conf\"\nuser" << s
+        << " = \"root\"\ninterval_seconds" << s << " = 30\nstatus" << s
+        << " = \"down\"\n";
+  }
+  out << "[script]\n";
+  for (int i = 0; i < programs; i++) {
+    std::string s = (i == 0) ? "" : std::to_string(i);
+    out << "location" << s << " = \"/tmp\"\npgm" << s
+        << " = \"alert.sh\"\noptions" << s << " = \"w" << i
+        << "\"\nthrottle_seconds" << s << " = 60\n";
+  }
+  return path;
+}
+
+static std::string writeScript() {
+  std::string path = benchDir() + "/bench_true.sh";
+  std::ofstream out(path, std::ios::trunc);
+  out << "#!/bin/sh\necho ok\n";
+  out.close();
+  chmod(path.c_str(), 0755);
+  return path;
+}
+
+int main(int argc, char *argv[]) {
+  std::string json_path = "bench.json";
+  std::string proc_root = "/proc";
+  size_t iterations = 1000;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string arg = argv[i];
+    if (arg == "--json") {
+      json_path = argv[i + 1];
+    } else if (arg == "--proc-root") {
+      proc_root = argv[i + 1];
+    } else if (arg == "--iterations") {
+      iterations = std::max<size_t>(10, std::stoul(argv[i + 1]));
+    }
+  }
+
+  std::vector<BenchResult> results;
+  auto report = [&](const BenchResult &r) {
+    printResult(r);
+    results.push_back(r);
+  };
+  std::cout << std::left << std::setw(28) << "benchmark" << std::right
+            << std::setw(10) << "iters" << std::setw(14) << "ns/op"
+            << std::setw(12) << "allocs/op" << std::setw(14) << "p50 ns"
+            << std::setw(14) << "p99 ns" << std::endl;
+
+  // scan and match
+  ProcessLister lister(proc_root);
+  report(runBench("getProcesses", iterations / 10 + 1,
+                  [&] { lister.getProcesses(); }));
+  std::vector<ProcessInfo> processes = lister.getProcesses();
+  const ProcessInfo *found = nullptr;
+  matchProcess miss{"no_such_process", "root", "x"};
+  report(runBench("searchProcess/miss", iterations,
+                  [&] { lister.searchProcess(processes, miss, found); }));
+  if (!processes.empty()) {
+    const ProcessInfo &last = processes.back();
+    matchProcess hit{last.name, last.user,
+                     last.arguments.empty() ? "" : last.arguments.back(),
+                     last.uid};
+    report(runBench("searchProcess/hit_last", iterations,
+                    [&] { lister.searchProcess(processes, hit, found); }));
+  }
+
+  // logger
+  Logger bench_log(benchDir() + "/bench.log");
+  report(runBench("Logger::log", iterations * 10,
+                  [&] { bench_log.log("process:  sshd found"); }));
+  std::string multiline;
+  for (int i = 0; i < 20; i++) {
+    multiline += "script output line " + std::to_string(i) + "\n";
+  }
+  report(runBench("Logger::logMultiline/20", iterations,
+                  [&] { bench_log.logMultiline(multiline); }));
+  Logger async_log(benchDir() + "/bench_async.log");
+  async_log.startAsync(8192, std::chrono::milliseconds(200));
+  report(runBench("Logger::log/async", iterations * 10,
+                  [&] { async_log.log("process:  sshd found"); }));
+  report(runBench("Logger::logMultiline/20/async", iterations,
+                  [&] { async_log.logMultiline(multiline); }));
+  async_log.stopAsync();
+
+  // script spawn, throttle 0 so every call runs the script
+  ShellScriptExecutor shell(writeScript(), {"arg"}, 0);
+  report(runBench("ShellScriptExecutor::execute", iterations / 10 + 1,
+                  [&] { shell.execute(); }));
+
+  // config parse
+  for (int programs : {1, 50}) {
+    std::string config = writeConfig(programs);
+    report(runBench("TomlParser/" + std::to_string(programs) + "_programs",
+                    iterations / 10 + 1,
+                    [&] { TomlParser parser(config); }));
+  }
+
+  writeJson(json_path, results);
+  std::cout << "results written to " << json_path << std::endl;
+  return 0;
+}
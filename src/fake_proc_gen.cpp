@@ -0,0 +1,252 @@
+// fake_proc_gen
+// writes a synthetic procfs tree (<dir>/<pid>/{cmdline,status,stat,comm})
+// for benchmarking the scanner at scale.  Point [monitor] proc_root or
+// ProcessLister(root) at the directory.
+//
+// usage: fake_proc_gen <dir> [--count N] [--args N] [--arg-len N]
+//                            [--users N] [--names N] [--churn PCT] [--seed N]
+//                            [--force]
+//
+// --churn on an existing tree removes PCT percent of its pids and adds as
+// many new ones with fresh start times, one run per simulated interval.
+//
+// A fresh tree replaces <dir>, so <dir> must be missing, empty or a tree
+// fake_proc_gen wrote (it leaves a .fake_proc_gen marker); --churn needs
+// the marker too.  --force skips the check.
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct GenOptions {
+  std::string dir;
+  int count = 1000;
+  int args = 4;      // arguments per process, after argv[0]
+  int arg_len = 24;  // bytes per argument
+  int users = 10;    // uid 0 and 1000.. 1000+users-2
+  int names = 300;   // distinct process names svc0.. svcN-1
+  int churn = -1;    // percent, -1 = write a fresh tree
+  unsigned seed = 42;
+  bool force = false; // replace or churn a directory without the marker
+};
+
+// written into every tree, so only those are ever deleted
+static const char kMarker[] = ".fake_proc_gen";
+
+static void usage() {
+  std::cout << "usage: fake_proc_gen <dir> [--count N] [--args N] "
+               "[--arg-len N] [--users N] [--names N] [--churn PCT] "
+               "[--seed N] [--force]"
+            << std::endl;
+}
+
+static bool parseArgs(int argc, char *argv[], GenOptions &opt) {
+  if (argc < 2) {
+    return false;
+  }
+  opt.dir = argv[1];
+  for (int i = 2; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--force") {
+      opt.force = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      return false;
+    }
+    int value = std::stoi(argv[++i]);
+    if (arg == "--count") {
+      opt.count = value;
+    } else if (arg == "--args") {
+      opt.args = value;
+    } else if (arg == "--arg-len") {
+      opt.arg_len = value;
+    } else if (arg == "--users") {
+      opt.users = std::max(1, value);
+    } else if (arg == "--names") {
+      opt.names = std::max(1, value);
+    } else if (arg == "--churn") {
+      opt.churn = std::clamp(value, 0, 100);
+    } else if (arg == "--seed") {
+      opt.seed = static_cast<unsigned>(value);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+class TreeWriter {
+public:
+  TreeWriter(const GenOptions &opt) : opt_(opt), rng_(opt.seed) {}
+
+  void writeProcess(int pid, unsigned long long starttime) {
+    std::uniform_int_distribution<int> name_d(0, opt_.names - 1),
+        user_d(0, opt_.users - 1), ch_d('a', 'z');
+    std::string name = "svc" + std::to_string(name_d(rng_));
+    int user = user_d(rng_);
+    long uid = (user == 0) ? 0 : 999 + user;
+
+    std::string cmdline = name;
+    cmdline += '\0';
+    for (int a = 0; a < opt_.args; a++) {
+      std::string arg = "--opt" + std::to_string(a) + "=";
+      while (static_cast<int>(arg.size()) < opt_.arg_len) {
+        arg += static_cast<char>(ch_d(rng_));
+      }
+      cmdline += arg;
+      cmdline += '\0';
+    }
+
+    fs::path pdir = fs::path(opt_.dir) / std::to_string(pid);
+    fs::create_directories(pdir);
+    writeFile(pdir / "cmdline", cmdline);
+    writeFile(pdir / "comm", name.substr(0, 15) + "\n");
+    writeFile(pdir / "status", status(pid, name, uid));
+    writeFile(pdir / "stat", stat(pid, name, starttime));
+  }
+
+  std::mt19937 &rng() { return rng_; }
+
+private:
+  static void writeFile(const fs::path &path, const std::string &data) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+  }
+
+  // roughly the size and layout of a real status file
+  static std::string status(int pid, const std::string &name, long uid) {
+    std::string u = std::to_string(uid);
+    std::string p = std::to_string(pid);
+    return "Name:\t" + name.substr(0, 15) +
+           "\nUmask:\t0022\nState:\tS (sleeping)\nTgid:\t" + p +
+           "\nNgid:\t0\nPid:\t" + p + "\nPPid:\t1\nTracerPid:\t0\nUid:\t" +
+           u + "\t" + u + "\t" + u + "\t" + u + "\nGid:\t" + u + "\t" + u +
+           "\t" + u + "\t" + u +
+           "\nFDSize:\t64\nGroups:\t\nNStgid:\t" + p + "\nNSpid:\t" + p +
+           "\nNSpgid:\t" + p + "\nNSsid:\t" + p +
+           "\nVmPeak:\t   12345 kB\nVmSize:\t   12345 kB\nVmLck:\t       0 kB"
+           "\nVmPin:\t       0 kB\nVmHWM:\t    4321 kB\nVmRSS:\t    4321 kB"
+           "\nRssAnon:\t    1234 kB\nRssFile:\t    3087 kB\nRssShmem:\t       "
+           "0 kB\nVmData:\t    1234 kB\nVmStk:\t     132 kB\nVmExe:\t      "
+           "64 kB\nVmLib:\t    2345 kB\nVmPTE:\t      48 kB\nVmSwap:\t       "
+           "0 kB\nThreads:\t1\nSigQ:\t0/63260\nSigPnd:\t0000000000000000"
+           "\nShdPnd:\t0000000000000000\nSigBlk:\t0000000000000000\nSigIgn:"
+           "\t0000000000001000\nSigCgt:\t0000000180004002\nCapInh:\t"
+           "0000000000000000\nCapPrm:\t0000000000000000\nCapEff:\t"
+           "0000000000000000\nCapBnd:\t000001ffffffffff\nCapAmb:\t"
+           "0000000000000000\nNoNewPrivs:\t0\nSeccomp:\t0\nSpeculation_Store_"
+           "Bypass:\tthread vulnerable\nCpus_allowed:\tff\nCpus_allowed_list:"
+           "\t0-7\nMems_allowed:\t1\nMems_allowed_list:\t0\n"
+           "voluntary_ctxt_switches:\t10\nnonvoluntary_ctxt_switches:\t1\n";
+  }
+
+  // starttime is field 22, as ProcSnapshot::parseStat expects
+  static std::string stat(int pid, const std::string &name,
+                          unsigned long long starttime) {
+    std::string p = std::to_string(pid);
+    return p + " (" + name.substr(0, 15) + ") S 1 " + p + " " + p +
+           " 0 -1 4194560 100 0 0 0 1 1 0 0 20 0 1 0 " +
+           std::to_string(starttime) +
+           " 12640256 1080 18446744073709551615 1 1 0 0 0 0 0 4096 "
+           "16386 0 0 0 17 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n";
+  }
+
+  const GenOptions &opt_;
+  std::mt19937 rng_;
+};
+
+static std::vector<int> existingPids(const std::string &dir) {
+  std::vector<int> pids;
+  for (const auto &entry : fs::directory_iterator(dir)) {
+    const std::string name = entry.path().filename().string();
+    if (entry.is_directory() && !name.empty() &&
+        std::all_of(name.begin(), name.end(),
+                    [](char c) { return c >= '0' && c <= '9'; })) {
+      pids.push_back(std::stoi(name));
+    }
+  }
+  std::sort(pids.begin(), pids.end());
+  return pids;
+}
+
+// A missing or empty directory, or one with the marker, is ours to change.
+static bool ownsTree(const GenOptions &opt, bool fresh) {
+  if (opt.force) {
+    return true;
+  }
+  std::error_code ec;
+  if (fresh && !fs::exists(opt.dir, ec)) {
+    return true;
+  }
+  if (!fs::is_directory(opt.dir, ec)) {
+    return false;
+  }
+  return (fresh && fs::is_empty(opt.dir, ec)) ||
+         fs::exists(fs::path(opt.dir) / kMarker, ec);
+}
+
+int main(int argc, char *argv[]) {
+  GenOptions opt;
+  try {
+    if (!parseArgs(argc, argv, opt)) {
+      usage();
+      return 1;
+    }
+  } catch (const std::exception &) {
+    usage();
+    return 1;
+  }
+
+  if (!ownsTree(opt, opt.churn < 0)) {
+    std::cout << opt.dir << " is not empty and was not written by "
+              << "fake_proc_gen (no " << kMarker
+              << " in it); use --force to " << (opt.churn < 0 ? "replace" : "churn")
+              << " it anyway" << std::endl;
+    return 1;
+  }
+
+  TreeWriter writer(opt);
+  try {
+    if (opt.churn < 0) {
+      fs::remove_all(opt.dir);
+      fs::create_directories(opt.dir);
+      std::ofstream(fs::path(opt.dir) / kMarker) << "fake_proc_gen\n";
+      for (int i = 0; i < opt.count; i++) {
+        writer.writeProcess(100 + i, 1000 + i);
+      }
+      std::cout << "wrote " << opt.count << " processes to " << opt.dir
+                << std::endl;
+      return 0;
+    }
+
+    std::vector<int> pids = existingPids(opt.dir);
+    if (pids.empty()) {
+      std::cout << "no pids under " << opt.dir << std::endl;
+      return 1;
+    }
+    size_t churned = pids.size() * static_cast<size_t>(opt.churn) / 100;
+    std::shuffle(pids.begin(), pids.end(), writer.rng());
+    for (size_t i = 0; i < churned; i++) {
+      fs::remove_all(fs::path(opt.dir) / std::to_string(pids[i]));
+    }
+    // new pids go above the highest one, like the kernel's pid counter
+    int next = *std::max_element(pids.begin(), pids.end()) + 1;
+    for (size_t i = 0; i < churned; i++) {
+      writer.writeProcess(next, 1000ULL + static_cast<unsigned>(next));
+      next++;
+    }
+    std::cout << "churned " << churned << " of " << pids.size()
+              << " processes in " << opt.dir << std::endl;
+  } catch (const fs::filesystem_error &e) {
+    std::cerr << "fake_proc_gen: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,88 @@
+// log_decode
+// converts a binary tinypsmon log (log_format = "binary") back to the text
+// format, or to JSON lines with --json.  Reads the files named, rotated
+// .gz files included, or stdin; text lines in the input are skipped.
+//
+// usage: log_decode [--json] [file ...]
+
+#include "log_format.hpp"
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
+
+static bool decodeFile(gzFile in, const std::string &name, LogDecoder &decoder) {
+  std::vector<char> buf(256 * 1024);
+  std::string out;
+  size_t held = 0; // an incomplete record carried to the next read
+  for (;;) {
+    if (held == buf.size()) {
+      buf.resize(buf.size() * 2); // a record larger than the buffer
+    }
+    int n = gzread(in, buf.data() + held, static_cast<unsigned>(buf.size() - held));
+    if (n < 0) {
+      int err;
+      std::cerr << name << ": " << gzerror(in, &err) << std::endl;
+      return false;
+    }
+    if (n == 0) {
+      break;
+    }
+    size_t len = held + static_cast<size_t>(n);
+    out.clear();
+    size_t used = decoder.feed(buf.data(), len, out);
+    fwrite(out.data(), 1, out.size(), stdout);
+    held = len - used;
+    std::copy(buf.begin() + used, buf.begin() + len, buf.begin());
+  }
+  if (held > 0) {
+    std::cerr << name << ": " << held << " bytes of a truncated record at the end"
+              << std::endl;
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  LogFormat to = LogFormat::text;
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--json") {
+      to = LogFormat::json;
+    } else if (arg == "-h" || arg == "--help") {
+      std::cout << "usage: log_decode [--json] [file ...]" << std::endl;
+      return 0;
+    } else {
+      files.push_back(arg);
+    }
+  }
+
+  LogDecoder decoder(to);
+  bool ok = true;
+  if (files.empty()) {
+    gzFile in = gzdopen(dup(STDIN_FILENO), "rb");
+    ok = in && decodeFile(in, "stdin", decoder);
+    if (in) {
+      gzclose(in);
+    }
+  }
+  for (const std::string &file : files) {
+    // gzread passes plain files through, so both kinds open here
+    gzFile in = gzopen(file.c_str(), "rb");
+    if (!in) {
+      std::cerr << file << ": cannot open" << std::endl;
+      ok = false;
+      continue;
+    }
+    ok = decodeFile(in, file, decoder) && ok;
+    gzclose(in);
+  }
+  fflush(stdout);
+  if (decoder.skipped() > 0) {
+    std::cerr << decoder.skipped() << " bytes that were not records skipped"
+              << std::endl;
+  }
+  return ok ? 0 : 1;
+}
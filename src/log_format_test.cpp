@@ -0,0 +1,194 @@
+// log_format_test
+// logs the same records as text, JSON lines and binary, synchronously and
+// through the async writer, and checks that each JSON line is what was
+// logged, that decoding the binary log gives back the text log line for
+// line, that odd values survive (quotes, newlines, control bytes, empty
+// and long strings, NaN) and that the decoder skips garbage and waits for
+// a record split across reads.
+
+#include "logger.h"
+#include "test_check.hpp"
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static std::string readFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+static const std::vector<std::string> kArgs = {"-D", "say \"hi\"", "",
+                                               "tab\there"};
+
+// the same records in every format; stamps all fall in the same second
+// often enough, so text is compared without its prefix
+static void logRecords(Logger &log) {
+  std::string longName(100000, 'n');
+  for (int i = 0; i < 50; i++) {
+    log.event("process", {{"pid", i},
+                          {"name", "sshd"},
+                          {"user", std::string("root")},
+                          {"args", kArgs},
+                          {"nargs", kArgs.size()}});
+  }
+  log.log("plain message");
+  log.event("odd", {{"neg", -42L},
+                    {"big", UINT64_MAX},
+                    {"ratio", 0.25},
+                    {"nan", std::nan("")},
+                    {"ok", true},
+                    {"ctl", std::string_view("a\nb\x01", 4)},
+                    {"long", longName}});
+  log.event("empty", {});
+}
+
+static std::string writeLog(const std::string &path, LogFormat format,
+                            bool async) {
+  std::filesystem::remove(path);
+  {
+    Logger log(path);
+    log.setFormat(format);
+    if (async) {
+      log.startAsync(16, std::chrono::milliseconds(5));
+    }
+    logRecords(log);
+  }
+  std::string data = readFile(path);
+  std::filesystem::remove(path);
+  return data;
+}
+
+static std::vector<std::string> splitLines(const std::string &text) {
+  std::vector<std::string> lines;
+  std::istringstream in(text);
+  std::string line;
+  while (std::getline(in, line)) {
+    lines.push_back(line);
+  }
+  return lines;
+}
+
+// the "%D %r %Z " prefix: date, time, AM/PM and zone
+static std::string dropPrefix(const std::string &line) {
+  size_t pos = 0;
+  for (int i = 0; i < 4 && pos != std::string::npos; i++) {
+    pos = line.find(' ', pos + 1);
+  }
+  return pos == std::string::npos ? line : line.substr(pos + 1);
+}
+
+static void testFormats(bool async) {
+  std::string mode = async ? "async" : "sync";
+  const std::string path = "/tmp/log_format_test.log";
+  std::string text = writeLog(path, LogFormat::text, async);
+  std::string json = writeLog(path, LogFormat::json, async);
+  std::string binary = writeLog(path, LogFormat::binary, async);
+
+  std::vector<std::string> textLines = splitLines(text);
+  check(textLines.size() == 54, mode + ": text has a line per record, the "
+                                       "control field splitting one");
+  check(textLines[0].find("process pid=0 name=sshd user=root args=[-D say "
+                          "\"hi\"  tab\there] nargs=4") != std::string::npos,
+        mode + ": text event");
+  check(dropPrefix(textLines[50]) == "plain message",
+        mode + ": plain message text unchanged");
+
+  std::vector<std::string> jsonLines = splitLines(json);
+  check(jsonLines.size() == 53, mode + ": one JSON object per line");
+  check(jsonLines[7].find(",\"event\":\"process\",\"pid\":7,\"name\":\"sshd\","
+                          "\"user\":\"root\",\"args\":[\"-D\",\"say "
+                          "\\\"hi\\\"\",\"\",\"tab\\there\"],\"nargs\":4}") !=
+            std::string::npos,
+        mode + ": JSON event");
+  check(jsonLines[50].find(",\"msg\":\"plain message\"}") != std::string::npos,
+        mode + ": JSON plain message");
+  check(jsonLines[51].find("\"neg\":-42,\"big\":18446744073709551615,"
+                           "\"ratio\":0.25,\"nan\":null,\"ok\":true,"
+                           "\"ctl\":\"a\\nb\\u0001\"") != std::string::npos,
+        mode + ": JSON numbers and escapes");
+  check(jsonLines[52].rfind("{\"ts\":", 0) == 0 &&
+            jsonLines[52].find("\"event\":\"empty\"}") != std::string::npos,
+        mode + ": JSON event without fields");
+
+  std::string decoded;
+  LogDecoder decoder;
+  size_t used = decoder.feed(binary.data(), binary.size(), decoded);
+  check(used == binary.size() && decoder.records() == 53 &&
+            decoder.skipped() == 0,
+        mode + ": binary decodes whole");
+  check(binary.size() < json.size(), mode + ": binary is smaller than JSON (" +
+                                         std::to_string(binary.size()) + " < " +
+                                         std::to_string(json.size()) + ")");
+  std::vector<std::string> decodedLines = splitLines(decoded);
+  bool same = decodedLines.size() == textLines.size();
+  for (size_t i = 0; same && i < textLines.size(); i++) {
+    same = dropPrefix(decodedLines[i]) == dropPrefix(textLines[i]);
+  }
+  check(same, mode + ": decoded binary matches the text log");
+
+  std::string decodedJson;
+  LogDecoder toJson(LogFormat::json);
+  toJson.feed(binary.data(), binary.size(), decodedJson);
+  std::vector<std::string> decodedJsonLines = splitLines(decodedJson);
+  same = decodedJsonLines.size() == jsonLines.size();
+  for (size_t i = 0; same && i < jsonLines.size(); i++) {
+    same = decodedJsonLines[i].substr(decodedJsonLines[i].find(',')) ==
+           jsonLines[i].substr(jsonLines[i].find(','));
+  }
+  check(same, mode + ": binary decoded to JSON matches the JSON log");
+}
+
+static void testDecoderInput() {
+  const std::string path = "/tmp/log_format_test.log";
+  std::filesystem::remove(path);
+  {
+    Logger log(path);
+    log.log("a text line before the format is set");
+    log.setFormat(LogFormat::binary);
+    log.event("one", {{"n", 1}});
+    log.event("two", {{"n", 2}});
+  }
+  std::string data = readFile(path);
+  std::filesystem::remove(path);
+
+  std::string out;
+  LogDecoder decoder;
+  size_t used = decoder.feed(data.data(), data.size(), out);
+  check(used == data.size() && decoder.records() == 2 &&
+            decoder.skipped() > 0,
+        "leading text skipped, records after it decoded");
+
+  // every split point: what is left over must decode once the rest comes
+  bool splits = true;
+  for (size_t cut = 1; cut < data.size(); cut++) {
+    std::string first;
+    std::string rest;
+    LogDecoder d;
+    size_t took = d.feed(data.data(), cut, first);
+    std::string remaining = data.substr(took);
+    d.feed(remaining.data(), remaining.size(), rest);
+    if (d.records() != 2 || splitLines(first + rest).size() != 2) {
+      splits = false;
+    }
+  }
+  check(splits, "records split across reads decode");
+
+  std::string corrupt = data;
+  corrupt[corrupt.size() - 9] = static_cast<char>(0xff); // its type byte
+  out.clear();
+  LogDecoder d;
+  d.feed(corrupt.data(), corrupt.size(), out);
+  check(d.records() == 1, "a damaged record is dropped, not misread");
+}
+
+int main() {
+  testFormats(false);
+  testFormats(true);
+  testDecoderInput();
+  return testResult();
+}
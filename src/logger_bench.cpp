@@ -0,0 +1,64 @@
+// logger_bench
+// lines/sec through Logger::log from 1, 4 and 8 producer threads, in
+// synchronous and async mode, with the per-thread timestamp cache off
+// (localtime_r and strftime for every line, as before the cache) and on.
+//
+// usage: logger_bench [lines per thread]   (default 50000)
+
+#include "logger.h"
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static double linesPerSecond(bool async, bool cache, int threads, int lines) {
+  const std::string path = "/tmp/logger_bench.log";
+  std::filesystem::remove(path);
+  double seconds;
+  {
+    Logger log(path);
+    log.setTimestampCache(cache);
+    if (async) {
+      log.startAsync(8192, std::chrono::milliseconds(200));
+    }
+    std::vector<std::thread> pool;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++) {
+      pool.emplace_back([&log, lines] {
+        for (int i = 0; i < lines; i++) {
+          log.log("process:  sshd found");
+        }
+      });
+    }
+    for (auto &th : pool) {
+      th.join();
+    }
+    log.stopAsync(); // count the writing, not just the queueing
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                            start)
+                  .count();
+  }
+  std::filesystem::remove(path);
+  return threads * lines / seconds;
+}
+
+int main(int argc, char *argv[]) {
+  int lines = (argc > 1) ? std::stoi(argv[1]) : 50000;
+  std::cout << std::left << std::setw(8) << "mode" << std::setw(9)
+            << "threads" << std::right << std::setw(14) << "uncached/s"
+            << std::setw(14) << "cached/s" << std::setw(10) << "speedup"
+            << std::endl;
+  for (bool async : {false, true}) {
+    for (int threads : {1, 4, 8}) {
+      double before = linesPerSecond(async, false, threads, lines);
+      double after = linesPerSecond(async, true, threads, lines);
+      std::cout << std::left << std::setw(8) << (async ? "async" : "sync")
+                << std::setw(9) << threads << std::right << std::setw(14)
+                << static_cast<long>(before) << std::setw(14)
+                << static_cast<long>(after) << std::setw(9) << std::fixed
+                << std::setprecision(2) << after / before << "x" << std::endl;
+    }
+  }
+  return 0;
+}
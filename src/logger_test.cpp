@@ -0,0 +1,238 @@
+// logger_test
+// logs from several threads through the async logger with a small queue,
+// so producers have to wait for room, and checks that every line reaches
+// the file whole and in each thread's order; also checks flush(), the
+// return to synchronous logging and the time spent in log() per mode.
+// Rotation is checked too: compressing a large rotated file happens on
+// the rotation worker, so log() must not stall behind it; and the
+// rotation policy: the size limit in both modes, against the byte counter,
+// and retention by count.
+
+#include "logger.h"
+#include "test_check.hpp"
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::vector<std::string> readLines(const std::string &path) {
+  std::ifstream in(path);
+  std::vector<std::string> lines;
+  std::string line;
+  while (std::getline(in, line)) {
+    lines.push_back(line);
+  }
+  return lines;
+}
+
+// ns per log() call, threads logging lines lines each
+static double logFrom(Logger &log, int threads, int lines) {
+  std::vector<std::thread> pool;
+  auto start = std::chrono::steady_clock::now();
+  for (int t = 0; t < threads; t++) {
+    pool.emplace_back([&log, t, lines] {
+      for (int i = 0; i < lines; i++) {
+        log.log("t" + std::to_string(t) + " " + std::to_string(i));
+      }
+    });
+  }
+  for (auto &th : pool) {
+    th.join();
+  }
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now() - start)
+             .count() /
+         (threads * lines);
+}
+
+static size_t gunzippedSize(const std::string &path) {
+  gzFile in = gzopen(path.c_str(), "rb");
+  if (!in) {
+    return 0;
+  }
+  std::vector<char> buf(1 << 16);
+  size_t total = 0;
+  int n;
+  while ((n = gzread(in, buf.data(), buf.size())) > 0) {
+    total += n;
+  }
+  gzclose(in);
+  return total;
+}
+
+// rotated files of path, compressed or not
+static std::vector<std::string> rotatedFiles(const std::string &path) {
+  std::vector<std::string> found;
+  std::string base = std::filesystem::path(path).filename().string() + ".";
+  for (const auto &entry : std::filesystem::directory_iterator(
+           std::filesystem::path(path).parent_path())) {
+    std::string name = entry.path().filename().string();
+    if (name.rfind(base, 0) == 0) {
+      found.push_back(entry.path().string());
+    }
+  }
+  return found;
+}
+
+static bool isGz(const std::string &file) {
+  return file.size() > 3 && file.compare(file.size() - 3, 3, ".gz") == 0;
+}
+
+static void testRotation(const std::string &path) {
+  std::filesystem::remove(path);
+  Logger log(path);
+  log.setCompressionLevel(9); // slow on purpose
+  std::string line(200, 'x');
+  for (int i = 0; i < 200000; i++) {
+    log.log(line);
+  }
+  size_t rotated = std::filesystem::file_size(path);
+
+  auto start = std::chrono::steady_clock::now();
+  log.rotateNow();
+  double rotate_ms = std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+  // compressing 45 MB at level 9 takes seconds; rotateNow() must not
+  // (the worker may have its .gz.tmp open already)
+  bool plain = false;
+  bool gzipped = false;
+  for (const auto &f : rotatedFiles(path)) {
+    gzipped = gzipped || isGz(f);
+    plain = plain || (!isGz(f) && f.find(".gz.tmp") == std::string::npos);
+  }
+  check(plain && !gzipped, "rotation returns before the file is compressed");
+  double worst_us = 0;
+  for (int i = 0; i < 2000; i++) {
+    auto t = std::chrono::steady_clock::now();
+    log.log("during compression " + std::to_string(i));
+    worst_us = std::max(worst_us, std::chrono::duration<double, std::micro>(
+                                      std::chrono::steady_clock::now() - t)
+                                      .count());
+  }
+  log.waitRotation();
+  std::cout << "rotation: " << rotate_ms << " ms to rotate " << rotated
+            << " bytes, worst log() while compressing " << worst_us << " us"
+            << std::endl;
+
+  std::vector<std::string> after = rotatedFiles(path);
+  std::string gz = (after.size() == 1 && isGz(after[0])) ? after[0] : "";
+  check(!gz.empty(), "waitRotation() leaves only the .gz");
+  check(!gz.empty() && gunzippedSize(gz) == rotated,
+        "the .gz holds the whole rotated file");
+  check(readLines(path).size() >= 2000, "logging went on in the new file");
+  for (const auto &f : after) {
+    std::filesystem::remove(f);
+  }
+  std::filesystem::remove(path);
+}
+
+static void testPolicy(const std::string &dir, bool async) {
+  std::string mode = async ? "async" : "sync";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  const std::string path = dir + "/policy.log";
+  {
+    Logger log(path);
+    RotationPolicy policy;
+    policy.period = RotationPolicy::Period::none;
+    policy.max_bytes = 64 * 1024;
+    policy.keep_files = 3;
+    policy.keep_days = 0;
+    log.setRotationPolicy(policy);
+    if (async) {
+      log.startAsync(256, std::chrono::milliseconds(10));
+    }
+    std::string line(100, 'p');
+    for (int i = 0; i < 5000; i++) { // about 600 KB: nine rotations or so
+      log.log(line);
+    }
+    log.flush();
+    log.waitRotation();
+    uint64_t counted = log.currentFileBytes();
+    check(counted == std::filesystem::file_size(path),
+          mode + ": byte counter matches the file (" + std::to_string(counted) +
+              ")");
+    check(counted < policy.max_bytes + 256 * 128,
+          mode + ": file rotated near max_bytes");
+    std::vector<std::string> rotated = rotatedFiles(path);
+    check(rotated.size() == 3, mode + ": keep_files leaves 3 rotated logs (" +
+                                   std::to_string(rotated.size()) + ")");
+    size_t total = 0;
+    bool compressed = true;
+    for (const auto &f : rotated) {
+      compressed = compressed && isGz(f);
+      total += gunzippedSize(f);
+    }
+    check(compressed && total >= 3 * policy.max_bytes,
+          mode + ": kept logs are whole and compressed");
+  }
+  std::filesystem::remove_all(dir);
+}
+
+int main() {
+  const std::string path = "/tmp/logger_test.log";
+  const int threads = 8;
+  const int lines = 20000;
+  std::filesystem::remove(path);
+
+  {
+    Logger log(path);
+    log.startAsync(64, std::chrono::milliseconds(50));
+    check(log.isAsync(), "async mode on");
+    double ns = logFrom(log, threads, lines);
+    std::cout << "async: " << static_cast<long>(ns) << " ns per log(), "
+              << log.fullWaits() << " waits for room" << std::endl;
+    log.flush();
+    check(readLines(path).size() == static_cast<size_t>(threads * lines),
+          "flush() writes everything queued");
+
+    log.log("last async line");
+    log.stopAsync();
+    check(!log.isAsync(), "stopAsync() returns to synchronous logging");
+    log.log("sync line");
+  }
+
+  std::vector<std::string> written = readLines(path);
+  check(written.size() == static_cast<size_t>(threads * lines + 2),
+        "no line lost (" + std::to_string(written.size()) + ")");
+  std::map<int, int> next;
+  bool whole = true;
+  bool ordered = true;
+  for (size_t i = 0; i < static_cast<size_t>(threads * lines); i++) {
+    const std::string &line = written[i];
+    size_t t = line.rfind(" t");
+    if (t == std::string::npos) {
+      whole = false;
+      continue;
+    }
+    int thread = std::stoi(line.substr(t + 2));
+    int seq = std::stoi(line.substr(line.find(' ', t + 1) + 1));
+    if (seq != next[thread]++) {
+      ordered = false;
+    }
+  }
+  check(whole, "every line is whole");
+  check(ordered, "each thread's lines are in order");
+  check(written[written.size() - 2].find("last async line") !=
+                std::string::npos &&
+            written.back().find("sync line") != std::string::npos,
+        "queued lines come before later synchronous ones");
+
+  std::filesystem::remove(path);
+  {
+    Logger log(path);
+    double ns = logFrom(log, threads, lines / 10);
+    std::cout << "sync: " << static_cast<long>(ns) << " ns per log()"
+              << std::endl;
+  }
+  std::filesystem::remove(path);
+
+  testRotation(path);
+  testPolicy("/tmp/logger_test_policy", false);
+  testPolicy("/tmp/logger_test_policy", true);
+
+  return testResult();
+}
@@ -16,6 +16,8 @@
 #include <fcntl.h>
 #include <ios>
 #include <iostream>
+#include <list>
+#include <memory>
 #ifdef __FreeBSD__
 #include <kvm.h>  //freebsd
 #endif
@@ -37,7 +39,13 @@ Logger logger("tinypsmon.log");
 #endif
 #ifndef __FreeBSD__
 #include "linux_process.hpp"
+#include "proc_events.hpp"
+#include "event_loop.hpp"
+#include "pid_watch.hpp"
+#include "proc_snapshot.hpp"
 #endif
+#include "timer_wheel.hpp"
+#include "watch_engine.hpp"
 
 using namespace hmta;
 
@@ -46,50 +54,29 @@ using namespace hmta;
 struct InitializationResult {
   std::vector<Program> programs;
   std::vector<Script> scripts;
+  Monitor monitor;
 };
 
 ProcessLister ps;
+#ifndef __FreeBSD__
+ProcEventMonitor proc_events;
+ProcSnapshot proc_snapshot;
+bool incremental_scan = false;
+#endif
 
-class mypoll {
-
-public:
-  mypoll(std::string s, matchProcess &m, ShellScriptExecutor my_shell,
-         bool ps_s)
-      : _s(s), _m(m), _shell_1(my_shell), ps_status(ps_s) {}
-
-  bool operator()() {
-    const ProcessInfo *ps_t = nullptr;
-    std::cout << "mypoll:  " << _s << std::endl;
-    logger.log("Testing ps... ");
-    std::vector<ProcessInfo> processes = ps.getProcesses();
-    
-    _found = ps.searchProcess(processes, _m, ps_t);
-    if (_found == true) {
-      logger.log("process:  " + _m.process_name + " found");
-    }
-    
-    if (ps_status == _found) {
-      if (ps_t != nullptr) {
-        ps.logSingleProcess(*ps_t);
-      }
-      std::cout << "status change.. running script\n";
-      logger.log("status change.. running script");
-      std::string output = _shell_1.execute();
-      std::cout << "Script output: \n" << output << std::endl;
-      logger.log("Script output start: ");
-      logger.logMultiline(output);
-      logger.log("Script output end:");
-    }
-    return (true);
+// Current process table, from the process connector when it is running.
+std::vector<ProcessInfo> processSnapshot() {
+#ifndef __FreeBSD__
+  if (proc_events.isRunning()) {
+    return proc_events.getProcesses();
   }
-
-private:
-  std::string _s;
-  matchProcess &_m;
-  bool _found = false;
-  ShellScriptExecutor _shell_1;
-  bool ps_status = false;
-};
+  // only the watch engine refreshes the incremental table, it owns the deltas
+  if (incremental_scan && proc_snapshot.size() > 0) {
+    return proc_snapshot.getProcesses();
+  }
+#endif
+  return ps.getProcesses();
+}
 
 std::optional<InitializationResult> initialize(const std::string &file_path) {
   try {
@@ -108,7 +95,7 @@ std::optional<InitializationResult> initialize(const std::string &file_path) {
     std::cout << "  parms: " << programs[0].parms << "\n";
     std::cout << "  user: " << programs[0].user << "\n";
 
-    return InitializationResult{programs, scripts};
+    return InitializationResult{programs, scripts, parser.getMonitor()};
   } catch (const std::exception &e) {
     std::cerr << "Invalid TOML file: " << e.what() << std::endl;
     return std::nullopt;
@@ -166,49 +153,283 @@ void processCmdLine(const std::string &cmdparm) {
   }
 }
 
+// The [script] entry's native action; throws std::invalid_argument.
+NativeAction makeNativeAction(const Script &script) {
+  auto kind = NativeAction::parseKind(script.action);
+  if (!kind) {
+    throw std::invalid_argument("unknown action " + script.action);
+  }
+  switch (*kind) {
+  case NativeAction::Kind::signal:
+    return NativeAction::signal(script.signal, script.throttle_seconds);
+  case NativeAction::Kind::restart:
+    return NativeAction::restart(script.command, script.throttle_seconds);
+  case NativeAction::Kind::append:
+    return NativeAction::append(script.file, script.message,
+                                script.throttle_seconds);
+  case NativeAction::Kind::touch:
+    return NativeAction::touch(script.file, script.throttle_seconds);
+  case NativeAction::Kind::notify:
+    return NativeAction::notify(script.target, script.message,
+                                script.throttle_seconds);
+  }
+  throw std::invalid_argument("unknown action " + script.action);
+}
+
 int main(int argc, char *argv[]) {
   auto initResult = initialize("config.toml");
   if (!initResult) {
     return EXIT_FAILURE;
   }
 
+#ifndef __FreeBSD__
+  if (initResult->monitor.proc_root != "/proc") {
+    ps.setProcRoot(initResult->monitor.proc_root);
+    proc_snapshot.setRoot(initResult->monitor.proc_root);
+    logger.log("scanning procfs root " + initResult->monitor.proc_root);
+  }
+#endif
+
   if (argc > 1) {
     std::string cmdline1 = argv[1];
     processCmdLine(cmdline1);
     exit(0);
   }
 
-  // Use the first program and script for simplicity
-  const Program &program = initResult->programs[0];
-  const Script &script = initResult->scripts[0];
+  auto launcher =
+      ShellScriptExecutor::parseLauncher(initResult->monitor.script_launcher);
+  if (!launcher) {
+    logger.log("unknown script_launcher " + initResult->monitor.script_launcher +
+               ", using spawn");
+    launcher = ShellScriptExecutor::Launcher::spawn;
+  }
 
-  std::vector<std::string> opts = {script.options};
-  std::string script1 = script.location + "/" + script.pgm;
-  auto alarm_sh = ShellScriptExecutor(script1, opts, script.throttle_seconds);
+  // fork the zygote while the daemon is still small and single threaded
+  if (*launcher == ShellScriptExecutor::Launcher::zygote) {
+    if (zygote().start()) {
+      logger.log("script zygote started, pid " +
+                 std::to_string(zygote().pid()));
+      zygote().onStopped([](int status) {
+        logger.log("script zygote died (" +
+                   std::string(WIFSIGNALED(status)
+                                   ? "signal " + std::to_string(WTERMSIG(status))
+                                   : "exit " + std::to_string(WEXITSTATUS(status))) +
+                   "), scripts fall back to spawn");
+      });
+    } else {
+      logger.log("script zygote failed to start, using spawn");
+    }
+  }
 
-  if (!alarm_sh.isShellgood()) {
-    std::cout << "bad script: " << script1 << "  - correct toml config "
-              << std::endl;
-    exit(4);
+  ScriptCapture::Limits capture_limits;
+  capture_limits.max_bytes =
+      static_cast<size_t>(std::max(initResult->monitor.script_output_limit, 0));
+  capture_limits.timeout =
+      std::chrono::seconds(std::max(initResult->monitor.script_timeout_seconds, 0));
+
+  logger.setCompressionLevel(initResult->monitor.log_compress_level);
+  RotationPolicy rotation;
+  auto period = RotationPolicy::parsePeriod(initResult->monitor.log_rotate);
+  if (!period) {
+    logger.log("unknown log_rotate " + initResult->monitor.log_rotate +
+               ", using daily");
+    period = RotationPolicy::Period::daily;
+  }
+  rotation.period = *period;
+  rotation.max_bytes =
+      static_cast<uint64_t>(std::max<int64_t>(initResult->monitor.log_max_bytes, 0));
+  rotation.max_age =
+      std::chrono::minutes(std::max(initResult->monitor.log_max_age_minutes, 0));
+  rotation.keep_files = std::max(initResult->monitor.log_keep_files, 0);
+  rotation.keep_days = std::max(initResult->monitor.log_keep_days, 0);
+  logger.setRotationPolicy(rotation);
+  auto log_format = parseLogFormat(initResult->monitor.log_format);
+  if (!log_format) {
+    logger.log("unknown log_format " + initResult->monitor.log_format +
+               ", using text");
+  } else if (*log_format != LogFormat::text) {
+    logger.log("log format " + initResult->monitor.log_format);
+    logger.setFormat(*log_format);
+  }
+  if (initResult->monitor.log_async) {
+    logger.startAsync(
+        static_cast<size_t>(std::max(initResult->monitor.log_queue, 1)),
+        std::chrono::milliseconds(initResult->monitor.log_flush_ms));
+    logger.log("async logging, flush every " +
+               std::to_string(initResult->monitor.log_flush_ms) + " ms");
   }
 
-  const struct ::timespec rqt = {100, 0};
+  WatchEngine engine(ps);
+  size_t script_watches = 0; // watches without a native action
+  for (size_t i = 0; i < initResult->programs.size(); i++) {
+    const Program &program = initResult->programs[i];
+    const Script &script = initResult->scripts[i];
+
+    std::optional<NativeAction> native;
+    if (script.action != "script") {
+      try {
+        native = makeNativeAction(script);
+      } catch (const std::invalid_argument &e) {
+        std::cout << "bad action: " << e.what() << "  - correct toml config "
+                  << std::endl;
+        exit(4);
+      }
+    }
 
-  matchProcess m = {program.pgm, program.user, program.parms};
-  bool ps_state = processState(program.status);
+    std::vector<std::string> opts = {script.options};
+    std::string script1 = script.location + "/" + script.pgm;
+    auto alarm_sh = ShellScriptExecutor(script1, opts, script.throttle_seconds,
+                                        *launcher);
+    alarm_sh.setCaptureLimits(capture_limits);
 
-  mypoll pspoll("mypoll", m, alarm_sh, ps_state);
-  TimerAlarm<mypoll> timer(pspoll, program.interval_seconds);
+    if (!native) {
+      ++script_watches;
+    }
+    if (!native && !alarm_sh.isShellgood()) {
+      std::cout << "bad script: " << script1 << "  - correct toml config "
+                << std::endl;
+      exit(4);
+    }
+
+    matchProcess m = {program.pgm, program.user, program.parms};
+    // resolve the user once so matching compares uids
+    m.uid = uidCache().uid(program.user).value_or(-1);
+    if (m.uid < 0) {
+      logger.log(" unknown user " + program.user + ", matching by name");
+    }
+    bool ps_state = processState(program.status);
+
+    engine.addWatch(program.pgm + ":" + program.parms, m, ps_state, alarm_sh,
+                    program.interval_seconds, program.max_interval_seconds,
+                    native);
+  }
+  engine.setAdaptive(initResult->monitor.interval_growth,
+                     initResult->monitor.churn_threshold);
+  engine.setCoalesceWindow(
+      std::chrono::milliseconds(initResult->monitor.coalesce_window_ms));
+  engine.compile();
+  logger.log("watches: " + std::to_string(engine.size()) + " in " +
+             std::to_string(engine.intervals().size()) + " interval groups");
+
+#ifndef __FreeBSD__
+  // Everything below runs on this one event loop.  Signals are blocked
+  // before any thread is started so they all end up on its signalfd.
+  EventLoop loop;
+  loop.onSignal(SIGTERM, [&loop]() {
+    logger.log("SIGTERM received, shutting down");
+    loop.stop();
+  });
+  loop.onSignal(SIGHUP, []() {
+    logger.log("SIGHUP received: config reload is not supported, restart "
+               "to apply config changes");
+  });
+  // kill -USR1 logs every watch's state and effective interval
+  loop.onSignal(SIGUSR1, [&engine]() { engine.logStatus(); });
+  // Scripts are reaped by ShellScriptExecutor; restarted commands have no
+  // one waiting for them.
+  loop.onSignal(SIGCHLD, []() { NativeAction::reapRestarted(); });
+
+  if (initResult->monitor.process_events) {
+    if (proc_events.start()) {
+      engine.useProcessEvents(proc_events);
+      proc_events.setListener(
+          [&engine](unsigned what, int pid, const ProcessInfo *proc) {
+            engine.onProcessEvent(what, pid, proc);
+          });
+      logger.log("process connector enabled");
+    } else {
+      logger.log("process connector unavailable, polling /proc");
+    }
+  }
+
+  incremental_scan = initResult->monitor.incremental_scan;
+  if (incremental_scan) {
+    engine.useIncremental(proc_snapshot);
+  }
+
+  PidWatcher liveness;
+  if (initResult->monitor.pidfd_liveness) {
+    engine.useLiveness(liveness);
+    loop.addFd(liveness.fd(), EPOLLIN, [&liveness, &engine](uint32_t) {
+      for (int pid : liveness.wait(0)) {
+        engine.onPidExit(pid);
+      }
+    });
+    logger.log("pidfd liveness enabled");
+  }
+
+  // the interval timers run on the wheel, the wheel on the loop
+  int wheel_fd = timerWheel().pollFd();
+  if (wheel_fd >= 0) {
+    loop.addFd(wheel_fd, EPOLLIN, [](uint32_t) { timerWheel().dispatch(); });
+  }
+#endif
+
+  // scripts run on worker threads, their results come back to the loop.  A
+  // script run blocks its thread until the script exits or times out, so
+  // inline scripts would stall the loop and every other watch with it.
+  int action_workers = initResult->monitor.action_workers;
+  if (action_workers <= 0 && script_watches > 0) {
+    logger.log("action_workers 0 would run scripts on the event loop, using 1");
+    action_workers = 1;
+  }
+  std::unique_ptr<ActionPool> actions;
+  if (action_workers > 0) {
+    auto overflow = ActionPool::parseOverflow(initResult->monitor.action_overflow)
+                        .value_or(ActionPool::Overflow::reject);
+    // a blocked submit would stall the check, and the event loop with it,
+    // holding the engine lock that completions need
+    if (overflow == ActionPool::Overflow::block) {
+      logger.log("action_overflow block would stall the checks, using reject");
+      overflow = ActionPool::Overflow::reject;
+    }
+    actions = std::make_unique<ActionPool>(
+        action_workers, initResult->monitor.action_queue,
+        overflow, initResult->monitor.action_concurrency);
+#ifndef __FreeBSD__
+    actions->setPoster([&loop](std::function<void()> fn) {
+      loop.post(std::move(fn));
+    });
+#endif
+    engine.useActionPool(*actions);
+    logger.log("action pool: " + std::to_string(action_workers) + " workers");
+  }
 
-  timer.arm();
+  // one timer per interval group, all driven by the shared timer wheel
+  std::list<WatchGroupPoll> polls;
+  std::list<WheelTimer<WatchGroupPoll>> timers;
+  for (int interval : engine.intervals()) {
+    polls.emplace_back(engine, interval);
+    timers.emplace_back(polls.back(), interval);
+    timers.back().arm();
+  }
   printBanner();
 
+#ifndef __FreeBSD__
+  loop.addTimer(std::chrono::seconds(100), [&engine]() {
+    logger.log("Main loop");
+    std::vector<ProcessInfo> processes = processSnapshot();
+    ps.logProcesses(processes);
+    engine.logStatus();
+  });
+  loop.run();
+
+  timers.clear();
+  actions.reset();
+  proc_events.stop();
+  logger.log("tinypsmon stopped");
+  logger.stopAsync(); // write out whatever is still queued
+#else
+  const struct ::timespec rqt = {100, 0};
   while (true) {
     logger.log("Main loop");
-    std::vector<ProcessInfo> processes = ps.getProcesses();
+    std::vector<ProcessInfo> processes = processSnapshot();
     ps.logProcesses(processes);
+    engine.logStatus();
+    NativeAction::reapRestarted();
     nanosleep(&rqt, nullptr);
   }
+#endif
 
   return EXIT_SUCCESS;
 }
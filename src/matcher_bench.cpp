@@ -0,0 +1,148 @@
+// matcher_bench
+// compares CompiledMatcher against the searchProcess loop
+// (one ProcessLister::matchesCriteria pass per watch) at 10, 100 and 1000
+// watches over a synthetic process table, and checks that both give the
+// same results, for processes whose uid could not be read as well.
+
+#include "logger.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+Logger logger("matcher_bench.log");
+#include "linux_process.hpp"
+#include "process_matcher.hpp"
+
+static std::vector<ProcessInfo> makeProcesses(size_t count, std::mt19937 &rng) {
+  std::uniform_int_distribution<int> name_d(0, 299), uid_d(0, 9),
+      nargs_d(2, 8), len_d(8, 30), ch_d('a', 'z'), token_d(0, 1999),
+      coin_d(0, 3);
+  std::vector<ProcessInfo> processes;
+  for (size_t i = 0; i < count; i++) {
+    ProcessInfo proc;
+    proc.pid = static_cast<int>(i + 100);
+    proc.name = "svc" + std::to_string(name_d(rng));
+    proc.uid = uid_d(rng);
+    proc.user = "user" + std::to_string(proc.uid);
+    if (coin_d(rng) == 0) {
+      proc.uid = -1; // status unreadable, matched by user name
+    }
+    proc.arguments.push_back(proc.name);
+    int nargs = nargs_d(rng);
+    for (int a = 0; a < nargs; a++) {
+      std::string arg;
+      int len = len_d(rng);
+      for (int c = 0; c < len; c++) {
+        arg += static_cast<char>(ch_d(rng));
+      }
+      if (coin_d(rng) == 0) {
+        arg += "--token" + std::to_string(token_d(rng));
+      }
+      proc.arguments.push_back(arg);
+    }
+    processes.push_back(proc);
+  }
+  return processes;
+}
+
+static std::vector<matchProcess> makeWatches(size_t count, std::mt19937 &rng) {
+  std::uniform_int_distribution<int> name_d(0, 299), uid_d(0, 9),
+      token_d(0, 1999);
+  std::vector<matchProcess> watches;
+  for (size_t i = 0; i < count; i++) {
+    matchProcess m;
+    m.process_name = "svc" + std::to_string(name_d(rng));
+    m.uid = uid_d(rng);
+    m.username = "user" + std::to_string(m.uid);
+    m.argument = "token" + std::to_string(token_d(rng));
+    watches.push_back(m);
+  }
+  return watches;
+}
+
+// what WatchEngine did before: a searchProcess style loop per watch
+static std::vector<const ProcessInfo *>
+loopMatch(const std::vector<ProcessInfo> &processes,
+          const std::vector<matchProcess> &watches) {
+  std::vector<const ProcessInfo *> found(watches.size(), nullptr);
+  for (size_t w = 0; w < watches.size(); w++) {
+    for (const auto &process : processes) {
+      if (ProcessLister::matchesCriteria(process, watches[w])) {
+        found[w] = &process;
+        break;
+      }
+    }
+  }
+  return found;
+}
+
+// a process for each watch that only matches it by user name
+static bool unreadUidMatches(const std::vector<matchProcess> &watches) {
+  std::vector<ProcessInfo> processes;
+  for (const auto &m : watches) {
+    ProcessInfo proc;
+    proc.pid = static_cast<int>(processes.size() + 100);
+    proc.name = m.process_name;
+    proc.uid = -1;
+    proc.user = m.username;
+    proc.arguments = {m.process_name, "--" + m.argument};
+    processes.push_back(proc);
+  }
+  CompiledMatcher matcher(watches);
+  std::vector<const ProcessInfo *> got = matcher.match(processes);
+  return got == loopMatch(processes, watches) &&
+         std::none_of(got.begin(), got.end(),
+                      [](const ProcessInfo *p) { return p == nullptr; });
+}
+
+template <typename Fn> static double nsPerRun(int runs, Fn &&fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < runs; r++) {
+    fn();
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() / runs;
+}
+
+int main(int argc, char *argv[]) {
+  size_t nprocs = (argc > 1) ? std::stoul(argv[1]) : 5000;
+  std::mt19937 rng(42);
+  std::vector<ProcessInfo> processes = makeProcesses(nprocs, rng);
+  int status = 0;
+
+  std::cout << "processes: " << nprocs << std::endl;
+  std::cout << "watches   loop ns/scan   compiled ns/scan   speedup  matched"
+            << std::endl;
+  for (size_t nwatches : {10, 100, 1000}) {
+    std::vector<matchProcess> watches = makeWatches(nwatches, rng);
+    CompiledMatcher matcher(watches);
+
+    std::vector<const ProcessInfo *> expect = loopMatch(processes, watches);
+    std::vector<const ProcessInfo *> got = matcher.match(processes);
+    if (expect != got) {
+      std::cout << "MISMATCH at " << nwatches << " watches" << std::endl;
+      status = 1;
+    }
+    if (!unreadUidMatches(watches)) {
+      std::cout << "MISMATCH at " << nwatches
+                << " watches for processes without a uid" << std::endl;
+      status = 1;
+    }
+    size_t matched = std::count_if(got.begin(), got.end(),
+                                   [](const ProcessInfo *p) { return p; });
+
+    int runs = std::max<int>(3, static_cast<int>(20000 / nwatches));
+    double loop_ns = nsPerRun(runs, [&] { loopMatch(processes, watches); });
+    double compiled_ns = nsPerRun(runs, [&] { matcher.match(processes); });
+    std::cout << std::setw(7) << nwatches << std::setw(15)
+              << static_cast<long long>(loop_ns) << std::setw(19)
+              << static_cast<long long>(compiled_ns) << std::setw(9)
+              << std::fixed << std::setprecision(1) << loop_ns / compiled_ns
+              << "x" << std::setw(9) << matched << std::endl;
+  }
+  return status;
+}
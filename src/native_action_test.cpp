@@ -0,0 +1,191 @@
+// native_action_test
+// checks NativeAction: signal names and numbers, notify targets (unix
+// path length, udp host and [v6] ports), the {watch}/{pid}/{state}
+// expansion in appended lines and datagrams, touch, restart, signalling a
+// child and the throttle.
+
+#include "native_action.hpp"
+#include "test_check.hpp"
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+static std::string readFile(const std::string &path) {
+  std::ifstream in(path);
+  return std::string(std::istreambuf_iterator<char>(in), {});
+}
+
+template <typename F> static bool throwsInvalid(F f) {
+  try {
+    f();
+  } catch (const std::invalid_argument &) {
+    return true;
+  }
+  return false;
+}
+
+static void testParseSignal() {
+  check(NativeAction::parseSignal("TERM") == SIGTERM, "TERM");
+  check(NativeAction::parseSignal("SIGHUP") == SIGHUP, "SIG prefix");
+  check(NativeAction::parseSignal("9") == SIGKILL, "number");
+  check(!NativeAction::parseSignal("0"), "0 is not a signal");
+  check(!NativeAction::parseSignal(std::to_string(NSIG)), "NSIG is out of range");
+  check(!NativeAction::parseSignal("99999999999999999999"),
+        "a huge number is rejected, not thrown");
+  check(!NativeAction::parseSignal("-15"), "negative number");
+  check(!NativeAction::parseSignal("SIG"), "SIG alone");
+  check(!NativeAction::parseSignal("term"), "names are upper case");
+  check(!NativeAction::parseSignal(""), "empty");
+  check(throwsInvalid([] { NativeAction::signal("BOGUS", 0); }),
+        "signal() throws for an unknown name");
+}
+
+static void testTargets() {
+  check(throwsInvalid([] { NativeAction::notify("unix:", "m", 0); }),
+        "empty unix path");
+  check(throwsInvalid([] {
+          NativeAction::notify("unix:/" + std::string(200, 'p'), "m", 0);
+        }),
+        "unix path longer than sun_path");
+  check(!throwsInvalid([] {
+          NativeAction::notify("unix:/" + std::string(100, 'p'), "m", 0);
+        }),
+        "unix path that fits");
+  check(!throwsInvalid([] { NativeAction::notify("udp:127.0.0.1:9", "m", 0); }),
+        "udp v4");
+  check(!throwsInvalid([] { NativeAction::notify("udp:[::1]:9", "m", 0); }),
+        "udp [v6]");
+  check(throwsInvalid([] { NativeAction::notify("udp:127.0.0.1", "m", 0); }),
+        "udp without a port");
+  check(throwsInvalid([] { NativeAction::notify("tcp:127.0.0.1:9", "m", 0); }),
+        "unknown scheme");
+  check(throwsInvalid([] { NativeAction::restart({}, 0); }),
+        "restart without a command");
+  check(throwsInvalid([] {
+          NativeAction::restart({"no-such-command-native-action-test"}, 0);
+        }),
+        "restart command not in PATH");
+  check(throwsInvalid([] { NativeAction::restart({"/etc/passwd"}, 0); }),
+        "restart command not executable");
+  check(throwsInvalid([] { NativeAction::restart({"/bin"}, 0); }),
+        "restart command is a directory");
+  check(!throwsInvalid([] { NativeAction::restart({"/bin/true"}, 0); }),
+        "restart command by path");
+  check(throwsInvalid([] { NativeAction::append("", "m", 0); }),
+        "append without a file");
+  check(throwsInvalid([] { NativeAction::touch("", 0); }),
+        "touch without a file");
+}
+
+static void testAppend() {
+  const std::string path = "/tmp/native_action_test.log";
+  ::unlink(path.c_str());
+  NativeAction a = NativeAction::append(
+      path, "{watch} {state} {pid} {unknown} {pid", 0);
+  std::string done = a.execute({"sshd", 42, true});
+  a.execute({"sshd", -1, false});
+  check(done == "appended to " + path, "append result");
+  check(readFile(path) == "sshd up 42 {unknown} {pid\n"
+                          "sshd down -1 {unknown} {pid\n",
+        "keys expanded, unknown and unclosed ones left as written");
+  ::unlink(path.c_str());
+}
+
+static void testTouch() {
+  const std::string path = "/tmp/native_action_test.touch";
+  ::unlink(path.c_str());
+  NativeAction a = NativeAction::touch(path, 0);
+  check(a.execute({}) == "touched " + path, "touch result");
+  struct stat st;
+  check(::stat(path.c_str(), &st) == 0, "touch creates the file");
+  struct timespec old[2] = {{1000, 0}, {1000, 0}};
+  ::utimensat(AT_FDCWD, path.c_str(), old, 0);
+  a.execute({});
+  ::stat(path.c_str(), &st);
+  check(st.st_mtime > 1000, "touch sets the time to now");
+  ::unlink(path.c_str());
+}
+
+static void testNotify() {
+  int sock = ::socket(AF_INET6, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  struct sockaddr_in6 addr = {};
+  addr.sin6_family = AF_INET6;
+  addr.sin6_addr = in6addr_loopback;
+  socklen_t len = sizeof(addr);
+  if (sock < 0 ||
+      ::bind(sock, reinterpret_cast<struct sockaddr *>(&addr), len) < 0) {
+    std::cout << "no IPv6 loopback, udp [v6] delivery not checked" << std::endl;
+    if (sock >= 0) {
+      ::close(sock);
+    }
+    return;
+  }
+  ::getsockname(sock, reinterpret_cast<struct sockaddr *>(&addr), &len);
+  std::string target = "udp:[::1]:" + std::to_string(ntohs(addr.sin6_port));
+  NativeAction a = NativeAction::notify(target, "{watch} is {state}", 0);
+  check(a.execute({"nginx", 7, false}) == "notified " + target,
+        "notify result");
+  char buf[128];
+  struct timeval tv = {2, 0};
+  ::setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  ssize_t n = ::recv(sock, buf, sizeof(buf), 0);
+  check(n > 0 && std::string(buf, n) == "nginx is down",
+        "datagram over udp [v6], expanded");
+  ::close(sock);
+}
+
+static void testSignalAndThrottle() {
+  pid_t child = ::fork();
+  if (child == 0) {
+    ::pause();
+    _exit(0);
+  }
+  NativeAction a = NativeAction::signal("SIGTERM", 60);
+  bool threw = false;
+  try {
+    a.execute({"w", -1, true});
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  check(threw, "signal without a matched process fails");
+  // the failed run still started the throttle window
+  check(a.execute({"w", child, true}) ==
+            "Throttle time not reached. Action not executed.",
+        "throttled within the window");
+  int status = 0;
+  NativeAction b = NativeAction::signal("TERM", 60);
+  check(b.execute({"w", child, true}) ==
+            "sent TERM to pid " + std::to_string(child),
+        "signal result");
+  ::waitpid(child, &status, 0);
+  check(WIFSIGNALED(status) && WTERMSIG(status) == SIGTERM,
+        "the process got SIGTERM");
+
+  NativeAction r = NativeAction::restart({"true"}, 0);
+  std::string done = r.execute({});
+  check(done.rfind("restarted true as pid ", 0) == 0, "restart result");
+  pid_t pid = std::stoi(done.substr(done.rfind(' ') + 1));
+  for (int i = 0; i < 100 && ::kill(pid, 0) == 0; i++) {
+    NativeAction::reapRestarted();
+    ::usleep(10000);
+  }
+  check(::kill(pid, 0) < 0, "restarted command reaped");
+
+  NativeAction once = NativeAction::touch("/tmp/native_action_test.touch", 0);
+  once.execute({});
+  check(once.execute({}) == "touched /tmp/native_action_test.touch",
+        "throttle 0 runs every time");
+  ::unlink("/tmp/native_action_test.touch");
+}
+
+int main() {
+  testParseSignal();
+  testTargets();
+  testAppend();
+  testTouch();
+  testNotify();
+  testSignalAndThrottle();
+  return testResult();
+}
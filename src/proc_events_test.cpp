@@ -0,0 +1,110 @@
+// proc_events_test
+// forks and execs children and checks that ProcEventMonitor keeps its
+// table in step.  The live part needs CAP_NET_ADMIN and is skipped without.
+
+#include "proc_events.hpp"
+#include "test_check.hpp"
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+// fork + exec /bin/sleep with the marker as argv[0] so it is easy to find
+static pid_t spawnSleeper(const char *marker) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    execl("/bin/sleep", marker, "30", (char *)nullptr);
+    _exit(EXIT_FAILURE);
+  }
+  return pid;
+}
+
+static void reap(pid_t pid) {
+  kill(pid, SIGKILL);
+  int status;
+  waitpid(pid, &status, 0);
+}
+
+static bool hasMarker(ProcEventMonitor &mon, pid_t pid, const char *marker) {
+  for (const auto &proc : mon.getProcesses()) {
+    if (proc.pid == pid) {
+      for (const auto &arg : proc.arguments) {
+        if (arg == marker) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+template <typename Pred> static bool waitFor(Pred pred) {
+  for (int i = 0; i < 200; i++) {
+    if (pred()) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return false;
+}
+
+static void testSyntheticEvents() {
+  ProcEventMonitor mon;
+  pid_t child = spawnSleeper("tinypsmon_synthetic");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  struct proc_event ev = {};
+  ev.what = proc_event::PROC_EVENT_FORK;
+  ev.event_data.fork.child_pid = child;
+  ev.event_data.fork.child_tgid = child;
+  mon.applyEvent(ev);
+  check(mon.contains(child), "fork event adds the child");
+
+  ev = {};
+  ev.what = proc_event::PROC_EVENT_EXEC;
+  ev.event_data.exec.process_pid = child;
+  ev.event_data.exec.process_tgid = child;
+  mon.applyEvent(ev);
+  check(hasMarker(mon, child, "tinypsmon_synthetic"),
+        "exec event rereads cmdline");
+
+  ev = {};
+  ev.what = proc_event::PROC_EVENT_EXIT;
+  ev.event_data.exit.process_pid = child + 1;
+  ev.event_data.exit.process_tgid = child;
+  mon.applyEvent(ev);
+  check(mon.contains(child), "thread exit leaves the process");
+
+  reap(child);
+  ev.event_data.exit.process_pid = child;
+  mon.applyEvent(ev);
+  check(!mon.contains(child), "exit event removes the process");
+}
+
+static void testLiveEvents() {
+  ProcEventMonitor mon;
+  if (!mon.start()) {
+    std::cout << "SKIP: process connector unavailable" << std::endl;
+    return;
+  }
+  check(mon.size() > 0, "initial table loaded");
+
+  pid_t child = spawnSleeper("tinypsmon_live");
+  check(waitFor([&] { return hasMarker(mon, child, "tinypsmon_live"); }),
+        "fork/exec seen via connector");
+
+  reap(child);
+  check(waitFor([&] { return !mon.contains(child); }),
+        "exit seen via connector");
+  std::cout << "events applied: " << mon.eventsApplied() << std::endl;
+  mon.stop();
+}
+
+int main() {
+  testSyntheticEvents();
+  testLiveEvents();
+  return testResult();
+}
@@ -0,0 +1,126 @@
+// script_capture_test
+// runs small scripts through ShellScriptExecutor with each launcher and
+// checks line streaming of stdout and stderr, the byte cap, the timeout
+// (which must kill the script's whole process group) and exit statuses,
+// and the fall back to spawn when the zygote dies.
+
+#include "shell.hpp"
+#include "test_check.hpp"
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+static std::string writeScript(const std::string &name,
+                               const std::string &body) {
+  std::string path = "/tmp/script_capture_test_" + name + ".sh";
+  std::ofstream out(path);
+  out << "#!/bin/sh\n" << body;
+  out.close();
+  chmod(path.c_str(), 0755);
+  return path;
+}
+
+struct Lines {
+  std::vector<std::string> out;
+  std::vector<std::string> err;
+};
+
+static ScriptRun runScript(const std::string &path,
+                           ShellScriptExecutor::Launcher launcher,
+                           const ScriptCapture::Limits &limits, Lines &lines) {
+  ShellScriptExecutor shell(path, {"arg1"}, 0, launcher);
+  shell.setCaptureLimits(limits);
+  shell.setLineSink([&lines](const std::string &line, bool is_stderr) {
+    (is_stderr ? lines.err : lines.out).push_back(line);
+  });
+  return shell.run();
+}
+
+static void testLauncher(ShellScriptExecutor::Launcher launcher,
+                         const std::string &name) {
+  ScriptCapture::Limits limits;
+  limits.max_bytes = 4096;
+  limits.timeout = std::chrono::milliseconds(1000);
+
+  Lines lines;
+  ScriptRun r = runScript(
+      writeScript("lines", "echo one $1\necho two >&2\nprintf three\n"),
+      launcher, limits, lines);
+  check(r.executed && r.ok() && !r.truncated && !r.timed_out,
+        name + ": clean run");
+  check(lines.out == std::vector<std::string>({"one arg1", "three"}),
+        name + ": stdout lines, last one without a newline");
+  check(lines.err == std::vector<std::string>({"two"}),
+        name + ": stderr lines");
+  check(r.output == "one arg1\nthree", name + ": stdout returned");
+
+  lines = {};
+  r = runScript(writeScript("fail", "echo failing >&2\nexit 3\n"), launcher,
+                limits, lines);
+  check(!r.ok() && WEXITSTATUS(r.status) == 3, name + ": exit status 3");
+
+  lines = {};
+  r = runScript(writeScript("segv", "kill -SEGV $$\n"), launcher, limits,
+                lines);
+  check(!r.ok() && !r.timed_out && WIFSIGNALED(r.status) &&
+            WTERMSIG(r.status) == SIGSEGV,
+        name + ": killed by a signal is a failure");
+
+  lines = {};
+  r = runScript(writeScript("flood", "yes flood | head -c 1000000\n"),
+                launcher, limits, lines);
+  check(r.ok() && r.truncated && r.bytes == 1000000 &&
+            r.output.size() == limits.max_bytes,
+        name + ": output capped, the rest drained");
+
+  // the sleeps are in the script's process group and must die with it
+  lines = {};
+  auto start = std::chrono::steady_clock::now();
+  r = runScript(writeScript("hang", "echo started\nsleep 30 &\nsleep 30\n"),
+                launcher, limits, lines);
+  auto took = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+  check(r.timed_out && !r.ok() && WIFSIGNALED(r.status),
+        name + ": timed out and killed");
+  check(took.count() >= 1000 && took.count() < 2500,
+        name + ": run ends at the timeout (" + std::to_string(took.count()) +
+            " ms)");
+  check(lines.out == std::vector<std::string>({"started"}),
+        name + ": lines before the timeout are kept");
+}
+
+int main() {
+  if (!zygote().start()) {
+    std::cout << "zygote failed to start" << std::endl;
+    return 1;
+  }
+  testLauncher(ShellScriptExecutor::Launcher::spawn, "spawn");
+  testLauncher(ShellScriptExecutor::Launcher::fork, "fork");
+  testLauncher(ShellScriptExecutor::Launcher::zygote, "zygote");
+
+  ShellScriptExecutor failing(writeScript("fail", "exit 3\n"), {}, 0);
+  bool threw = false;
+  try {
+    failing.execute();
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  check(threw, "execute() throws on a failed script");
+
+  // a zygote that dies is noticed on the next launch, which falls back
+  int stopped_status = -1;
+  zygote().onStopped([&](int status) { stopped_status = status; });
+  ::kill(zygote().pid(), SIGKILL);
+  Lines lines;
+  ScriptRun r = runScript(writeScript("after", "echo after\n"),
+                          ShellScriptExecutor::Launcher::zygote, {}, lines);
+  check(r.ok() && lines.out == std::vector<std::string>({"after"}),
+        "zygote killed: the script still runs, through spawn");
+  check(!zygote().isRunning() && WIFSIGNALED(stopped_status) &&
+            WTERMSIG(stopped_status) == SIGKILL,
+        "zygote killed: reaped and reported once");
+
+  return testResult();
+}
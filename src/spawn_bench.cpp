@@ -0,0 +1,94 @@
+// spawn_bench
+// grows the process to each of a few resident sizes and times
+// ShellScriptExecutor::execute() running /bin/true with the fork, the
+// posix_spawn and the zygote launcher.  fork() copies the page tables, so
+// its cost grows with RSS; posix_spawn does not, and the zygote forks from
+// a process that stays at the size it had before the ballast.
+//
+// usage: spawn_bench [iterations] [rss MB ...]   (default 200  0 256 1024)
+
+#include "shell.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct Timing {
+  double mean_us;
+  double p50_us;
+  double p99_us;
+};
+
+static Timing timeLaunches(ShellScriptExecutor &shell, size_t iterations) {
+  std::vector<double> samples;
+  samples.reserve(iterations);
+  for (size_t i = 0; i < iterations; i++) {
+    auto start = std::chrono::steady_clock::now();
+    shell.execute();
+    samples.push_back(std::chrono::duration<double, std::micro>(
+                          std::chrono::steady_clock::now() - start)
+                          .count());
+  }
+  std::sort(samples.begin(), samples.end());
+  double sum = 0;
+  for (double s : samples) {
+    sum += s;
+  }
+  return Timing{sum / samples.size(), samples[samples.size() / 2],
+                samples[samples.size() * 99 / 100]};
+}
+
+static void report(const std::string &name, size_t rss_mb, const Timing &t) {
+  std::cout << name << " rss " << rss_mb << " MB: mean "
+            << static_cast<long>(t.mean_us) << " us, p50 "
+            << static_cast<long>(t.p50_us) << " us, p99 "
+            << static_cast<long>(t.p99_us) << " us" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  size_t iterations = (argc > 1) ? std::stoul(argv[1]) : 200;
+  std::vector<size_t> sizes;
+  for (int i = 2; i < argc; i++) {
+    sizes.push_back(std::stoul(argv[i]));
+  }
+  if (sizes.empty()) {
+    sizes = {0, 256, 1024};
+  }
+  std::sort(sizes.begin(), sizes.end());
+
+  if (!zygote().start()) {
+    std::cerr << "zygote failed to start" << std::endl;
+    return 1;
+  }
+  ShellScriptExecutor forked("/bin/true", {}, 0,
+                             ShellScriptExecutor::Launcher::fork);
+  ShellScriptExecutor spawned("/bin/true", {}, 0,
+                              ShellScriptExecutor::Launcher::spawn);
+  ShellScriptExecutor zygoted("/bin/true", {}, 0,
+                              ShellScriptExecutor::Launcher::zygote);
+
+  // touched so the pages are resident and mapped in the page tables
+  std::vector<char *> ballast;
+  size_t resident = 0;
+  for (size_t mb : sizes) {
+    for (; resident < mb; resident++) {
+      char *block = static_cast<char *>(std::malloc(1 << 20));
+      if (block == nullptr) {
+        std::cerr << "out of memory at " << resident << " MB" << std::endl;
+        return 1;
+      }
+      std::memset(block, 1, 1 << 20);
+      ballast.push_back(block);
+    }
+    report("fork  ", mb, timeLaunches(forked, iterations));
+    report("spawn ", mb, timeLaunches(spawned, iterations));
+    report("zygote", mb, timeLaunches(zygoted, iterations));
+  }
+
+  for (char *block : ballast) {
+    std::free(block);
+  }
+  return 0;
+}
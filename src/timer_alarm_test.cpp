@@ -0,0 +1,101 @@
+// timer_alarm_test
+// runs a slow functor on a short TimerAlarm interval in relative and in
+// absolute mode with each missed-deadline policy, and checks drift, missed
+// counts and the lateness/duration histograms.
+
+#include "TimerAlarm.h"
+#include "test_check.hpp"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+using namespace hmta;
+using namespace std::chrono_literals;
+
+struct SlowPoll {
+  std::chrono::milliseconds work;
+  std::chrono::steady_clock::time_point last;
+
+  bool operator()() {
+    last = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(work);
+    return (true);
+  }
+};
+
+struct RunResult {
+  double elapsed_ms;
+  size_t missed;
+  TimerHistogram lateness;
+  TimerHistogram duration;
+};
+
+// 100 ms interval, runs times, returns when the timer disarmed itself
+static RunResult runTimer(std::chrono::milliseconds work, size_t runs,
+                          timer_mode mode, missed_policy policy) {
+  SlowPoll poll{work, {}};
+  TimerAlarm<SlowPoll> timer(poll, 0, 100000000, runs);
+  timer.set_schedule(mode, policy);
+  auto start = std::chrono::steady_clock::now();
+  timer.arm();
+  while (timer.is_armed()) {
+    std::this_thread::sleep_for(5ms);
+  }
+  RunResult r;
+  r.elapsed_ms =
+      std::chrono::duration<double, std::milli>(poll.last - start).count();
+  r.missed = timer.missed_count();
+  r.lateness = timer.lateness_histogram();
+  r.duration = timer.duration_histogram();
+  return r;
+}
+
+static void print(const std::string &name, const RunResult &r) {
+  std::cout << name << ": last start " << static_cast<long>(r.elapsed_ms)
+            << " ms, missed " << r.missed << ", lateness mean "
+            << static_cast<long>(r.lateness.mean() / 1000) << " us p99 <= "
+            << r.lateness.percentile(99) / 1000 << " us, duration mean "
+            << static_cast<long>(r.duration.mean() / 1000000) << " ms"
+            << std::endl;
+}
+
+int main() {
+  // 30 ms of work on a 100 ms interval: relative drifts by the work time
+  RunResult rel = runTimer(30ms, 10, timer_mode::relative, missed_policy::skip);
+  RunResult abs = runTimer(30ms, 10, timer_mode::absolute, missed_policy::skip);
+  print("relative", rel);
+  print("absolute", abs);
+  check(rel.elapsed_ms > 1200, "relative mode drifts by the functor time");
+  check(abs.elapsed_ms > 990 && abs.elapsed_ms < 1050,
+        "absolute mode 10th run starts at 1000 ms");
+  check(abs.missed == 0, "no missed deadlines when the functor fits");
+  check(abs.lateness.count == 10 && abs.duration.count == 10,
+        "one histogram sample per run");
+  check(abs.duration.mean() > 29e6, "duration histogram sees the work");
+
+  // 250 ms of work on a 100 ms interval: deadlines are missed
+  RunResult skip =
+      runTimer(250ms, 4, timer_mode::absolute, missed_policy::skip);
+  RunResult coalesce =
+      runTimer(250ms, 4, timer_mode::absolute, missed_policy::coalesce);
+  RunResult catch_up =
+      runTimer(250ms, 4, timer_mode::absolute, missed_policy::catch_up);
+  print("skip", skip);
+  print("coalesce", coalesce);
+  print("catch_up", catch_up);
+  // skip: runs at 100, 400, 700, 1000; 2 deadlines dropped per run
+  check(skip.missed == 6, "skip drops the missed deadlines");
+  check(skip.elapsed_ms > 990 && skip.elapsed_ms < 1050,
+        "skip stays in phase");
+  check(skip.lateness.percentile(99) < 20000000, "skip runs on time");
+  // coalesce: runs at 100, 350, 600, 850, folding 1, 2 and 1 deadlines
+  check(coalesce.missed == 4, "coalesce folds missed deadlines into one run");
+  check(coalesce.elapsed_ms > 840 && coalesce.elapsed_ms < 900,
+        "coalesce runs right away");
+  // catch_up: every deadline gets its run, late
+  check(catch_up.missed == 0, "catch_up keeps every deadline");
+  check(catch_up.lateness.max_ns > 400000000, "catch_up runs fall behind");
+
+  return testResult();
+}
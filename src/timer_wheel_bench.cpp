@@ -0,0 +1,97 @@
+// timer_wheel_bench
+// runs N periodic timers (default 10000, intervals spread over 1..5 s) for a
+// few seconds, first as WheelTimers on one TimerWheel and then as
+// hmta::TimerAlarms with a thread each, and reports threads, memory and
+// wakeups for both.
+//
+// usage: timer_wheel_bench [timers] [seconds]
+
+#include "TimerAlarm.h"
+#include "timer_wheel.hpp"
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <string>
+#include <sys/resource.h>
+
+using namespace hmta;
+
+static std::atomic<uint64_t> g_fired{0};
+
+struct CountingPoll {
+  bool operator()() {
+    g_fired.fetch_add(1, std::memory_order_relaxed);
+    return (true);
+  }
+};
+
+// one field of /proc/self/status, e.g. "VmRSS" -> "12345 kB"
+static std::string statusField(const std::string &key) {
+  std::ifstream in("/proc/self/status");
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.compare(0, key.size() + 1, key + ":") == 0) {
+      size_t start = line.find_first_not_of(" \t", key.size() + 1);
+      return (start == std::string::npos) ? "" : line.substr(start);
+    }
+  }
+  return "?";
+}
+
+static long contextSwitches() {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_nvcsw + ru.ru_nivcsw;
+}
+
+static void report(const std::string &name, size_t timers, long switches,
+                   uint64_t wakeups) {
+  std::cout << name << ": timers " << timers << ", threads "
+            << statusField("Threads") << ", VmRSS " << statusField("VmRSS")
+            << ", VmSize " << statusField("VmSize") << ", fired "
+            << g_fired.load() << ", thread wakeups " << wakeups
+            << ", context switches " << switches << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  size_t ntimers = (argc > 1) ? std::stoul(argv[1]) : 10000;
+  int seconds = (argc > 2) ? std::stoi(argv[2]) : 6;
+  // off the whole seconds so no expiry races the end of the run
+  auto run_for = std::chrono::milliseconds(seconds * 1000 + 500);
+  CountingPoll poll;
+
+  {
+    TimerWheel wheel;
+    std::list<WheelTimer<CountingPoll>> timers;
+    for (size_t i = 0; i < ntimers; i++) {
+      timers.emplace_back(wheel, poll, 1 + i % 5);
+      timers.back().arm();
+    }
+    long before = contextSwitches();
+    std::this_thread::sleep_for(run_for);
+    report("wheel", ntimers, contextSwitches() - before, wheel.wakeups());
+  }
+
+  g_fired = 0;
+  {
+    // Each armed TimerAlarm is a detached thread that wakes once per fire.
+    std::list<TimerAlarm<CountingPoll>> timers;
+    size_t armed = 0;
+    try {
+      for (size_t i = 0; i < ntimers; i++) {
+        timers.emplace_back(poll, 1 + i % 5);
+        timers.back().arm();
+        armed++;
+      }
+    } catch (const std::exception &e) {
+      std::cout << "TimerAlarm: stopped at " << armed
+                << " timers: " << e.what() << std::endl;
+      timers.pop_back();
+    }
+    long before = contextSwitches();
+    std::this_thread::sleep_for(run_for);
+    report("TimerAlarm", armed, contextSwitches() - before, g_fired.load());
+  }
+  return 0;
+}
@@ -0,0 +1,147 @@
+// watch_engine_test
+// runs a WatchEngine in incremental mode over a small synthetic procfs tree
+// and checks that a matched process replaced under the same pid (an exec
+// that changed comm, or pid reuse with a new start time) is noticed, so
+// the watch goes down and its action runs, or stays up when the new
+// process matches too; and that a script dropped from a full action queue
+// with no poster does not deadlock the engine.
+
+#include "logger.h"
+#include "shell.hpp"
+#include "test_check.hpp"
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <set>
+#include <string>
+#include <thread>
+Logger logger("/tmp/watch_engine_test.log");
+#include "linux_process.hpp"
+#include "pid_watch.hpp"
+#include "proc_events.hpp"
+#include "proc_snapshot.hpp"
+#include "watch_engine.hpp"
+
+namespace fs = std::filesystem;
+
+static const std::string kRoot = "/tmp/watch_engine_test_proc";
+static const std::string kActions = "/tmp/watch_engine_test.actions";
+
+static void writeFile(const fs::path &path, const std::string &data) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out << data;
+}
+
+// the files ProcSnapshot and ProcScanner read; starttime is stat field 22
+static void writeProcess(int pid, const std::string &name, long uid,
+                         unsigned long long starttime) {
+  std::string p = std::to_string(pid);
+  std::string u = std::to_string(uid);
+  fs::path dir = fs::path(kRoot) / p;
+  fs::create_directories(dir);
+  writeFile(dir / "cmdline", name + std::string(1, '\0'));
+  writeFile(dir / "comm", name + "\n");
+  writeFile(dir / "status", "Name:\t" + name + "\nPid:\t" + p + "\nUid:\t" +
+                                u + "\t" + u + "\t" + u + "\t" + u + "\n");
+  writeFile(dir / "stat", p + " (" + name + ") S 1 " + p + " " + p +
+                              " 0 -1 4194560 100 0 0 0 1 1 0 0 20 0 1 0 " +
+                              std::to_string(starttime) + " 12640256 1080\n");
+}
+
+static size_t actionLines() {
+  std::ifstream in(kActions);
+  size_t n = 0;
+  for (std::string line; std::getline(in, line);) {
+    ++n;
+  }
+  return n;
+}
+
+// the watch's 1 s interval has passed, so the group's tick checks it
+static void tick(WatchEngine &engine) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(1050));
+  engine.evaluateGroup(1);
+}
+
+// Watch "svc" run by root, with a restart-style action that fires while it
+// is down.  After a first check finds pid 100, replace() rewrites that pid
+// and the next check must see the change.
+static void testReplacedUnderSamePid(const std::string &what,
+                                     const std::function<void()> &replace,
+                                     bool still_matches = false) {
+  fs::remove_all(kRoot);
+  fs::remove(kActions);
+  writeProcess(100, "svc", 0, 1000);
+  writeProcess(101, "other", 0, 1001);
+
+  ProcessLister ps(kRoot);
+  ProcSnapshot snapshot(kRoot);
+  WatchEngine engine(ps);
+  engine.useIncremental(snapshot);
+  engine.setCoalesceWindow(std::chrono::milliseconds(0));
+  matchProcess m = {"svc", "root", ""};
+  m.uid = 0;
+  ShellScriptExecutor shell("/bin/true", {}, 0);
+  engine.addWatch("svc", m, false, shell, 1, 0,
+                  NativeAction::append(kActions, "{watch} {state}", 0));
+  engine.compile();
+
+  engine.evaluateGroup(1);
+  check(engine.status()[0].found && actionLines() == 0,
+        what + ": found at first, no action");
+  tick(engine);
+  check(engine.status()[0].found && actionLines() == 0,
+        what + ": unchanged pid stays found");
+
+  replace();
+  tick(engine);
+  check(engine.status()[0].found == still_matches,
+        what + (still_matches ? ": watch stays up" : ": watch goes down"));
+  check(actionLines() == (still_matches ? 0 : 1),
+        what + (still_matches ? ": no action" : ": action runs"));
+}
+
+// Three watches of a missing process each queue a script on a pool with
+// one worker, room for one request, drop_oldest and no poster, so a
+// request is dropped while the engine holds its lock in submitAction.
+// Its completion must not run there (onActionDone takes the same lock).
+static void testDropWithoutPoster() {
+  fs::remove_all(kRoot);
+  fs::create_directories(kRoot);
+  ProcessLister ps(kRoot);
+  ProcSnapshot snapshot(kRoot);
+  WatchEngine engine(ps);
+  engine.useIncremental(snapshot);
+  ActionPool pool(1, 1, ActionPool::Overflow::drop_oldest);
+  engine.useActionPool(pool);
+  matchProcess m = {"svc", "root", ""};
+  m.uid = 0;
+  ShellScriptExecutor shell("/bin/sleep", {"0.2"}, 0);
+  for (const char *name : {"a", "b", "c"}) {
+    engine.addWatch(name, m, false, shell, 1);
+  }
+  engine.compile();
+
+  alarm(10); // a deadlock ends the test here
+  engine.evaluateGroup(1);
+  for (int i = 0; i < 100 && (pool.queued() > 0 || pool.running() > 0); i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  check(engine.status().size() == 3, "engine usable after the drop");
+  check(pool.dropped() >= 1, "a queued script was dropped");
+  alarm(0);
+}
+
+int main() {
+  testReplacedUnderSamePid("exec into another program",
+                           [] { writeProcess(100, "bash", 0, 1000); });
+  testReplacedUnderSamePid("pid reused by another user",
+                           [] { writeProcess(100, "svc", 1000, 5000); });
+  testReplacedUnderSamePid("pid reused by another svc",
+                           [] { writeProcess(100, "svc", 0, 5000); }, true);
+  testDropWithoutPoster();
+  fs::remove_all(kRoot);
+  fs::remove(kActions);
+  return testResult();
+}